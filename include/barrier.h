@@ -0,0 +1,45 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Barriera riutilizzabile a generazioni (futex condivisi)
+   I partecipanti (operatori e utenti) arrivano e dormono sulla
+   parola della generazione; il coordinatore (mensa) attende che
+   siano arrivati tutti, prepara la fase successiva e apre la
+   barriera incrementando la generazione, che sveglia tutti con una
+   sola chiamata. Tra la raccolta e l'apertura i partecipanti sono
+   fermi: mensa puo' leggere e azzerare lo stato condiviso senza lock.
+   --------------------------------------------------------- */
+
+/* FUTEX_WAIT/WAKE senza _PRIVATE: la parola e' in memoria condivisa
+   tra processi, anche se mappata a indirizzi diversi */
+static inline long futex_wait(uint32_t *parola, uint32_t atteso, const struct timespec *timeout) {
+    return syscall(SYS_futex, parola, FUTEX_WAIT, atteso, timeout, NULL, 0);
+}
+
+static inline long futex_wake(uint32_t *parola, int quanti) {
+    return syscall(SYS_futex, parola, FUTEX_WAKE, quanti, NULL, NULL, 0);
+}
+
+void barrier_init(barrier_t *b, int partecipanti);
+
+/* Partecipante: arriva e attende l'apertura della generazione */
+void barrier_wait(barrier_t *b);
+
+/* Coordinatore: attende al piu' timeout_ns (reali) che arrivino tutti;
+   0 se completa, -1 allo scadere */
+int  barrier_collect(barrier_t *b, long timeout_ns);
+void barrier_open(barrier_t *b);
+
+static inline int barrier_arrived(barrier_t *b) {
+    return (int)__atomic_load_n(&b->arrivati, __ATOMIC_ACQUIRE);
+}
+
+#endif
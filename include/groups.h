@@ -0,0 +1,47 @@
+#ifndef GROUPS_H
+#define GROUPS_H
+
+#include <semaphore.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Gruppi di utenti e mappa dei posti a tavola
+   I gruppi sono formati da mensa all'avvio con id consecutivi: il
+   primo e' il capogruppo, che percorre la mensa per tutto il gruppo
+   (richieste a lotti, un pagamento, un blocco di posti adiacenti).
+   --------------------------------------------------------- */
+
+typedef struct {
+    int capogruppo;                 // id del capogruppo dell'utente
+    int dimensione;                 // valido solo per il capogruppo
+} gruppo_t;
+
+/* Attesa oltre la quale un gruppo ha la precedenza sui singoli */
+#define GRUPPO_PRECEDENZA_MINUTI    5
+
+typedef struct {
+    sem_t mutex_posti;              // protegge posti[]
+    lockstat_t mutex_posti_stat;
+    int gruppi_in_precedenza;       // gruppi in attesa da oltre GRUPPO_PRECEDENZA_MINUTI
+    int num_utenti;
+    int num_posti;
+    int num_gruppi;
+    gruppo_t gruppo[];              // num_utenti elementi, poi num_posti byte di posti[]
+} groups_shm_t;
+
+void groups_create(shm_t *shm);
+void groups_attach(shm_t *shm);
+void groups_destroy(shm_t *shm);
+
+int groups_enabled(shm_t *shm);
+gruppo_t *group_of(int user_id);
+
+int  seats_take_single(void);
+int  seats_try_block(int n, sem_t *tavoli);
+void seats_release_block(int primo, int n);
+
+void seats_priority(int delta);
+int  seats_priority_pending(void);
+lockstat_t *seats_lockstat(void);
+
+#endif
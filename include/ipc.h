@@ -8,15 +8,32 @@ shm_t *ipc_attach_shared_memory(void);
 
 void ipc_destroy_shared_memory(void);
 
+/* Segmenti ausiliari con pagine grandi e prefault come shm_t */
+int   ipc_segment_create(size_t size, const char *nome);
+void *ipc_segment_attach(int id, const char *nome);
+
 void ipc_create_semaphores(void);
 void ipc_init_table_semaphore(void);
+void ipc_reset_table_semaphore(void);
 void ipc_destroy_semaphores(void);
 
 void ipc_create_message_queues(void);
 void ipc_destroy_message_queues(void);
 
-void ipc_signal_ready(void);
-void ipc_wait_barrier(void);
-void ipc_release_barrier(void);
+/* Stato di una richiesta in coda (pazienza degli utenti) */
+#define REQ_IN_ATTESA       1   // in coda, puo' essere annullata
+#define REQ_PRESA           2   // ricevuta da un operatore
+#define REQ_ANNULLATA       3   // l'utente ha rinunciato, l'operatore la scarta
+
+#define REQ_WORD(seq, stato)        (((uint32_t)(seq) << 2) | (stato))
+#define REQ_SLOT(user, station)     (req_slots[(user) * NUM_STATIONS + (station)])
+
+extern volatile uint32_t *req_slots;
+
+void ipc_create_request_slots(void);
+void ipc_attach_request_slots(void);
+void ipc_destroy_request_slots(void);
+
+long ipc_request_mtype(int station_type, int user_id, int piatti, uint64_t t_arrivo_ns);
 
 #endif
\ No newline at end of file
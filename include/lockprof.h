@@ -0,0 +1,32 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <semaphore.h>
+#include <time.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Profilo di contesa dei semafori condivisi (make LOCKPROF=1)
+   lock_wait/lock_timedwait/lock_post sostituiscono sem_wait,
+   sem_timedwait e sem_post registrando acquisizioni, attese e
+   tempo di possesso in un lockstat_t accanto al semaforo.
+   Senza MENSA_LOCKPROF sono le chiamate sem_* originali.
+   --------------------------------------------------------- */
+
+#ifdef MENSA_LOCKPROF
+
+int  lock_wait(sem_t *s, lockstat_t *ls);
+int  lock_timedwait(sem_t *s, lockstat_t *ls, const struct timespec *abs);
+int  lock_post(sem_t *s, lockstat_t *ls);
+
+#else
+
+#define lock_wait(s, ls)            sem_wait(s)
+#define lock_timedwait(s, ls, abs)  sem_timedwait((s), (abs))
+#define lock_post(s, ls)            sem_post(s)
+
+#endif
+
+void lockprof_print(shm_t *shm);
+
+#endif
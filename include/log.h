@@ -0,0 +1,70 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "shared_structs.h"
+
+/* Livelli di log */
+#define LOG_LVL_DEBUG   0
+#define LOG_LVL_INFO    1
+#define LOG_LVL_WARN    2
+#define LOG_LVL_ERROR   3
+#define LOG_LVL_OFF     4
+
+/* Livello minimo compilato: i livelli inferiori spariscono dal binario
+   (es. make LOG_COMPILE_LEVEL=2 compila solo WARN ed ERROR) */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LVL_DEBUG
+#endif
+
+#define LOG_MSG_LEN     124     // testo massimo per record (troncato oltre)
+#define LOG_RING_SLOTS  32      // record per processo (potenza di 2)
+
+/* Indice dell'anello di ogni processo nel segmento di log */
+#define LOG_SLOT_MENSA          0
+#define LOG_SLOT_OPERATORE(id)  (1 + (id))
+#define LOG_SLOT_UTENTE(id)     (1 + shm->NOFWORKERS + (id))
+
+typedef struct {
+    unsigned short len;
+    unsigned char  level;
+    char           text[LOG_MSG_LEN + 1];
+} log_rec_t;
+
+/* Anello single-producer (il processo) / single-consumer (writer di mensa) */
+typedef struct {
+    volatile unsigned int head;         // scritto solo dal produttore
+    unsigned int dropped;               // record persi ad anello pieno
+    char pad1[56];
+    volatile unsigned int tail;         // scritto solo dal writer
+    char pad2[60];
+    log_rec_t rec[LOG_RING_SLOTS];
+} log_ring_t;
+
+typedef struct {
+    int nrings;
+    int level;                          // livello runtime (LOGLEVEL)
+    log_ring_t rings[];
+} log_shm_t;
+
+extern int log_level;
+
+#define LOG_AT(lvl, ...)                                            \
+    do {                                                            \
+        if ((lvl) >= LOG_COMPILE_LEVEL && (lvl) >= log_level)       \
+            log_write((lvl), __VA_ARGS__);                          \
+    } while (0)
+
+#define LOG_DEBUG(...)  LOG_AT(LOG_LVL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)   LOG_AT(LOG_LVL_INFO,  __VA_ARGS__)
+#define LOG_WARN(...)   LOG_AT(LOG_LVL_WARN,  __VA_ARGS__)
+#define LOG_ERROR(...)  LOG_AT(LOG_LVL_ERROR, __VA_ARGS__)
+
+void log_create(shm_t *shm);
+void log_attach(shm_t *shm, int slot);
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void log_start_writer(shm_t *shm);
+void log_stop_writer(void);
+void log_destroy(shm_t *shm);
+
+#endif
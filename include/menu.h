@@ -0,0 +1,69 @@
+#ifndef MENU_H
+#define MENU_H
+
+#include <stdint.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Menu in memoria condivisa
+   Un segmento dimensionato al caricamento di menu.txt contiene, di
+   seguito: intestazione, tabella dei piatti, porzioni, contatori per
+   piatto della giornata e totali, nomi. I riferimenti sono offset
+   dall'inizio del segmento, validi in ogni processo; i nomi uguali
+   sono memorizzati una volta sola. All'attach si ricavano i puntatori
+   alle tabelle, cosi' l'accesso a un piatto costa una indicizzazione.
+   --------------------------------------------------------- */
+
+#define PORTATA_PRIMI       0
+#define PORTATA_SECONDI     1
+#define PORTATA_COFFEE      2
+#define NUM_PORTATE         3
+
+#define MENU_MAX_PIATTI     4096    // per portata (piatto_scelto a 12 bit)
+
+typedef struct {
+    uint32_t nome;              // offset del nome nel segmento
+    uint16_t portata;
+    uint16_t indice;            // posizione nella portata (piatto_scelto)
+} piatto_t;
+
+typedef struct {
+    size_t dimensione;
+    int num_piatti;
+    int conteggio[NUM_PORTATE];
+    int primo[NUM_PORTATE];     // indice in piatti[] del primo piatto della portata
+    uint32_t off_porzioni;      // int[num_piatti]
+    uint32_t off_giorno;        // piatto_stats_t[num_piatti]
+    uint32_t off_totale;        // piatto_stats_t[num_piatti]
+    piatto_t piatti[];
+} menu_shm_t;
+
+extern menu_shm_t *menu;
+extern int *menu_porzioni;
+extern piatto_stats_t *menu_giorno;
+extern piatto_stats_t *menu_totale;
+
+int  menu_create(shm_t *shm, char **nomi[NUM_PORTATE], const int conteggio[NUM_PORTATE]);
+void menu_attach(shm_t *shm);
+void menu_destroy(shm_t *shm);
+
+void menu_reset_day(void);
+void menu_update_totals(void);
+
+static inline int menu_count(int portata) {
+    return menu->conteggio[portata];
+}
+
+static inline int dish_slot(int portata, int piatto) {
+    return menu->primo[portata] + piatto;
+}
+
+static inline int *dish_portions(int portata, int piatto) {
+    return &menu_porzioni[dish_slot(portata, piatto)];
+}
+
+static inline const char *dish_name(int portata, int piatto) {
+    return (const char *)menu + menu->piatti[dish_slot(portata, piatto)].nome;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <time.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Strumentazione opzionale del percorso critico (make PROFILE=1)
+   Ogni processo accumula localmente il tempo speso in ogni fase e
+   lo somma ai contatori in memoria condivisa a fine giornata.
+   Senza MENSA_PROFILE le macro non generano codice.
+   --------------------------------------------------------- */
+
+#ifdef MENSA_PROFILE
+
+extern prof_counter_t prof_local[PROF_MAX_STAGES];
+
+static inline long prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+#define PROF_DECL(var)          long var = 0
+#define PROF_START(var)         ((var) = prof_now())
+#define PROF_END(stage, var)                                    \
+    do {                                                        \
+        prof_local[stage].total_ns += prof_now() - (var);       \
+        prof_local[stage].count++;                              \
+    } while (0)
+#define PROF_FLUSH(table, n)    prof_flush(table, n)
+
+void prof_flush(prof_counter_t *table, int n);
+
+#else
+
+#define PROF_DECL(var)          do { } while (0)
+#define PROF_START(var)         do { } while (0)
+#define PROF_END(stage, var)    do { } while (0)
+#define PROF_FLUSH(table, n)    do { } while (0)
+
+#endif
+
+void prof_print(shm_t *shm);
+
+#endif
@@ -2,73 +2,257 @@
 #define SHARED_STRUCTS_H
 
 #include <semaphore.h>
+#include <stdint.h>
 #include <time.h>
 
-#define MAX_PRIMI_TYPES     4
-#define MAX_SECONDI_TYPES   4
-#define MAX_COFFEE_TYPES    4
+#define NUM_STATIONS        4
+
+/* Linea di cache: i campi scritti da processi diversi durante la
+   giornata stanno su linee distinte (false sharing) */
+#define CACHE_LINE          64
+#define CACHE_ALIGNED       __attribute__((aligned(CACHE_LINE)))
+#define GIORNATA_MINUTI     240     // durata di una giornata simulata (4 ore)
+#define REFILL_MINUTI       10      // intervallo del rifornimento periodico
+#define FASCE_REFILL        (GIORNATA_MINUTI / REFILL_MINUTI)
+
+/* Modalita' di arrivo degli utenti (ARRIVALMODE) */
+#define ARRIVI_INSIEME      0       // tutti all'inizio della giornata
+#define ARRIVI_POISSON      1       // processo di Poisson a tasso costante
+#define ARRIVI_PICCO        2       // tasso a tratti con picco a mezzogiorno
+
+/* Controllo degli ingressi (GATEMODE) */
+#define INGRESSO_LIBERO     0
+#define INGRESSO_MAX_DENTRO 1       // al massimo GATEMAXINFLIGHT utenti in mensa
+#define INGRESSO_GETTONI    2       // token bucket: GATERATE utenti al minuto
+
+/* Disciplina delle code delle stazioni (QUEUEDISCIPLINE) */
+#define CODA_FIFO           0
+#define CODA_SJF            1       // prima le richieste con meno porzioni/piatti
+#define CODA_PRIORITA       2       // prima personale (PRIORITYUSERS) e un solo piatto
+
+/* mtype sulle code: le richieste hanno mtype in [1, MTYPE_RICHIESTA_MAX]
+   e l'operatore riceve con msgrcv(-MTYPE_RICHIESTA_MAX), cioe' il piu'
+   basso disponibile; le risposte stanno sopra, una per utente */
+#define MTYPE_RICHIESTA_MAX     999999999L
+#define MTYPE_RISPOSTA(id)      (MTYPE_RICHIESTA_MAX + 1 + (long)(id))
+
+/* Istogramma delle attese: ATTESA_SUDDIVISIONI classi per ogni
+   raddoppio dei secondi simulati (classe = 4*log2(1+s)) */
+#define ATTESA_CLASSI       64
+#define ATTESA_SUDDIVISIONI 4
+
+#define GRUPPO_MAX          6       // dimensione massima di un gruppo (quantita' a 3 bit)
+
+/* Pesi relativi del tasso di arrivo in ARRIVI_SLOT fasce uguali della
+   finestra ARRIVALWINDOW (giornata dalle 11:00, picco alle 12:00-12:30) */
+#define ARRIVI_SLOT         8
+#define CURVA_ARRIVI        { 2, 5, 8, 6, 4, 2, 1, 1 }
+
+/* Fasi misurate dalla strumentazione opzionale (make PROFILE=1) */
+#define PROF_OP_MSGRCV      0   // operatore: chiamata msgrcv
+#define PROF_OP_IDLE        1   // operatore: attesa con coda vuota
+#define PROF_OP_MUTEX       2   // operatore: attesa su st->mutex
+#define PROF_OP_SERVIZIO    3   // operatore: tempo di servizio
+#define PROF_OP_MSGSND      4   // operatore: invio risposta
+#define PROF_OP_STATS       5   // operatore: attesa su sem_stats
+#define PROF_OP_STAGES      6
+
+#define PROF_UT_PRIMI       0   // utente: stazione primi (tutti i tentativi)
+#define PROF_UT_SECONDI     1
+#define PROF_UT_COFFEE      2
+#define PROF_UT_CASSA       3
+#define PROF_UT_TAVOLO      4   // utente: attesa di un posto
+#define PROF_UT_PASTO       5
+#define PROF_UT_FINE_GIORNO 6   // utente: attesa degli altri a fine giornata
+#define PROF_UT_PREORDINE   7   // utente: primi, secondi e coffee in parallelo
+#define PROF_UT_STAGES      8
+
+#define PROF_MAX_STAGES     8
 
 typedef struct {
-    long mtype;              // tipo messaggio (stazione o utente)
-    int user_id;             
-    int richiesta_tipo;      // 0=primo, 1=secondo, 2=coffee, 3=cassa
-    int piatto_scelto;       
+    long total_ns;
+    long count;
+} prof_counter_t;
 
-    int ha_primo;
-    int ha_secondo;
-    int ha_coffee;
+/* Statistiche di contesa di un semaforo (make LOCKPROF=1) */
+typedef struct {
+    long acquisizioni;
+    long contese;               // acquisizioni che hanno dovuto attendere
+    long scadute;               // attese di lock_timedwait scadute senza acquisire
+    long attesa_ns;             // tempo totale di attesa
+    long max_possesso_ns;       // tempo massimo di possesso
+} lockstat_t;
+
+/* Barriera a generazioni tra processi (barrier.h) */
+typedef struct {
+    uint32_t generazione;       // parola futex dei partecipanti
+    uint32_t arrivati;          // parola futex del coordinatore
+    int partecipanti;
+} CACHE_ALIGNED barrier_t;
+
+/* ---------------------------------------------------------
+   Formato dei messaggi sulle code delle stazioni
+   Il corpo (escluso mtype) occupa 16 byte: una parola a 32 bit con
+   id utente (20 bit) e piatto (12 bit, indice nella portata del
+   menu), una parola a 32 bit con tipo, quantita' ed esito
+   impacchettati e un timestamp a 64 bit. Quattro corpi stanno in una linea di cache.
+   --------------------------------------------------------- */
+#define MSG_MAX_UTENTI      (1 << 20)
+
+/* Numero di sequenza della richiesta: stessa ampiezza nel messaggio e
+   nella parola dello slot (REQ_WORD), altrimenti dopo il giro del
+   contatore il CAS dell'operatore non riconosce piu' la richiesta */
+#define REQ_SEQ_BITS        14
+#define REQ_SEQ_MASK        ((1u << REQ_SEQ_BITS) - 1)
 
-    struct timespec t_arrivo;
+typedef struct {
+    long mtype;                         // tipo messaggio (stazione o utente)
+    unsigned int user_id        : 20;
+    unsigned int piatto_scelto  : 12;
+    unsigned int richiesta_tipo : 3;    // 0=primo, 1=secondo, 2=coffee, 3=cassa
+    unsigned int quantita       : 3;    // porzioni richieste (gruppi), almeno 1
+    unsigned int n_primi        : 3;    // cassa: piatti da pagare
+    unsigned int n_secondi      : 3;
+    unsigned int n_coffee       : 3;
+    unsigned int seq            : REQ_SEQ_BITS;   // numero della richiesta nello slot dell'utente
+    unsigned int ripetuta       : 1;    // altro piatto della portata dopo un esaurimento
+    unsigned int riservato      : 2;
+    uint64_t t_arrivo_ns;               // sim_now_ns() all'invio della richiesta
 } msg_request_t;
 
 typedef struct {
-    long mtype;              
-    int user_id;
-    int esito;               // 0=ok, 1=piatto terminato, 2=nessun piatto disponibile
-    int piatto_servito;
-    struct timespec t_servizio;
+    long mtype;
+    unsigned int user_id        : 20;
+    unsigned int piatto_servito : 12;
+    unsigned int esito          : 4;    // 0=ok, 1=piatto terminato, 2=nessun piatto disponibile
+    unsigned int quantita       : 3;    // porzioni servite
+    unsigned int riservato      : 25;
+    uint64_t t_servizio_ns;             // sim_now_ns() all'inizio del servizio
 } msg_response_t;
 
 #define MSG_REQ_SIZE  (sizeof(msg_request_t)  - sizeof(long))
 #define MSG_RES_SIZE  (sizeof(msg_response_t) - sizeof(long))
 
+/* Verifica a tempo di compilazione della dimensione del corpo */
+typedef char msg_req_size_check[(MSG_REQ_SIZE == 16) ? 1 : -1];
+typedef char msg_res_size_check[(MSG_RES_SIZE == 16) ? 1 : -1];
+typedef char req_seq_bits_check[(REQ_SEQ_BITS + 2 <= 32) ? 1 : -1];
+
+/* Una stazione occupa tre linee di cache: configurazione letta da
+   tutti, mutex con i campi che protegge, contatori della coda
+   aggiornati atomicamente dagli utenti. I contatori di ogni stazione
+   stanno sulla linea della sua coda: utenti di stazioni diverse non
+   si contendono la stessa linea. Mensa li riporta in stats_giorno a
+   fine giornata (stations_collect_day). */
 typedef struct {
-    int postazioni_totali;      
-    int postazioni_occupate;    
-
-    int porzioni[MAX_PRIMI_TYPES]; 
-
-    long tempo_attesa_totale_ns; 
+    int postazioni_totali;
+    int msgid;
+
+    sem_t mutex CACHE_ALIGNED;
+    lockstat_t mutex_stat;
+    int postazioni_occupate;    // sotto mutex
+
+    int utenti_in_coda CACHE_ALIGNED;
+    int richieste;              // utenti che si presentano alla stazione
+    int rinunce_arrivo;         // coda troppo lunga all'arrivo
+    int abbandoni_coda;         // pazienza esaurita in coda
+    int richieste_ripetute;     // nuovi tentativi dopo un piatto esaurito
     int utenti_serviti;
-    int utenti_in_coda;
-
-    int msgid;                  
-
-    sem_t mutex;               
-} station_t;
+    long tempo_attesa_totale_ns;
+} CACHE_ALIGNED station_t;
 
+/* Porta della mensa: coda FIFO a biglietti. Solo l'utente in testa
+   (biglietto == servito) valuta l'ammissione e consuma i gettoni. */
 typedef struct {
+    unsigned int prossimo_biglietto;
+    unsigned int biglietto_servito;
+    int in_mensa;               // ammessi non ancora usciti
+    int limite;                 // massimo di utenti in mensa (INGRESSO_MAX_DENTRO)
+    double gettoni;
+    uint64_t ultima_ricarica_ns;
+} ingresso_t;
+
+/* Contatori di un piatto nella giornata. Gli operatori li aggiornano
+   con operazioni atomiche fuori da st->mutex; il primo esaurimento si
+   registra con una CAS da 0. */
+typedef struct {
+    int richieste;              // richieste ricevute (messaggi)
+    int serviti;                // porzioni servite
+    int rifiuti;                // porzioni chieste a piatto esaurito
+    int rifiuti_prima;          // di cui alla prima scelta della portata
+    int stock;                  // porzioni al mattino
+    int riforniti;              // porzioni aggiunte in giornata
+    int avanzati;
+    int esaurito_min;           // minuto del primo esaurimento + 1, 0 = mai
+    int giorni_esaurito;        // solo nei totali
+} piatto_stats_t;
+
+/* I campi sono raggruppati per chi li scrive: ogni gruppo aggiornato
+   durante la giornata inizia su una propria linea di cache, cosi' gli
+   incrementi atomici degli utenti non invalidano la linea che gli
+   operatori modificano sotto sem_stats e viceversa. */
+typedef struct {
+    /* Aggiornati sotto sem_stats (utenti a fine percorso, operatori
+       a fine servizio) */
     int utenti_serviti;
     int utenti_non_serviti;
+    int utenti_in_attesa;
+    int utenti_respinti;        // coda alla porta troppo lunga all'arrivo
 
     int piatti_primi_serviti;
     int piatti_secondi_serviti;
     int piatti_coffee_serviti;
 
-    int piatti_primi_avanzati;
-    int piatti_secondi_avanzati;
-
     long tempo_attesa_primi_ns;
     long tempo_attesa_secondi_ns;
     long tempo_attesa_coffee_ns;
     long tempo_attesa_cassa_ns;
 
-    int operatori_attivi;
-    int pause_totali;
+    double ricavo_giornaliero;
 
-    int utenti_in_attesa;    
+    /* Gruppi (GROUPWEIGHTS) */
+    int gruppi_serviti;
+    long tempo_gruppo_ns;           // dall'arrivo al pagamento
+    long attesa_posti_gruppo_ns;    // dal pagamento al blocco di posti
 
-    double ricavo_giornaliero;
+    /* Distribuzione delle attese per stazione, pesata per porzione */
+    int attese_hist[NUM_STATIONS][ATTESA_CLASSI];
+
+    /* Aggiornati atomicamente dagli utenti; i contatori per stazione
+       sono in station_t */
+
+    /* Porta della mensa */
+    int utenti_ammessi CACHE_ALIGNED;
+    long attesa_ingresso_ns;
+
+    /* Permanenza in mensa dall'arrivo al pagamento */
+    long tempo_percorso_ns;
+    int utenti_percorso;
+
+    /* Aggiornati atomicamente dagli operatori */
+    int pause_totali CACHE_ALIGNED;
+    long pausa_ns[NUM_STATIONS];        // tempo simulato di postazione perso in pausa
+
+    /* Domanda di primi [0] e secondi [1], aggiornata senza lock;
+       i contatori per piatto sono nel segmento del menu (menu.h) */
+    int richieste_fascia[2][FASCE_REFILL];      // porzioni chieste alla prima scelta per fascia di REFILL_MINUTI
+
+    /* Scritti solo da mensa a inizio e fine giornata */
+    int operatori_attivi CACHE_ALIGNED;
+
+    /* Contatori delle stazioni, riportati a fine giornata */
+    int richieste_primi;        // domanda osservata per stazione
+    int richieste_secondi;
+    int richieste_coffee;
+    int richieste_cassa;
+    int rinunce_arrivo[NUM_STATIONS];
+    int abbandoni_coda[NUM_STATIONS];
+    int richieste_ripetute[NUM_STATIONS];
+
+    long capacita_ns[NUM_STATIONS];     // tempo simulato di postazione disponibile
+
+    int piatti_primi_avanzati;
+    int piatti_secondi_avanzati;
 } stats_t;
 
 typedef struct {
@@ -90,6 +274,9 @@ typedef struct {
     int AVGREFILLSECONDI;
     int MAXPORZIONIPRIMI;
     int MAXPORZIONISECONDI;
+    int REFILLPLAN;             // 1=rifornimenti dalla domanda prevista per piatto
+    int PLANSOLDOUTCOST;        // costo relativo di una porzione mancante
+    int PLANLEFTOVERCOST;       // costo relativo di una porzione avanzata
 
     int AVGSRVCPRIMI;
     int AVGSRVCMAINCOURSE;
@@ -97,48 +284,94 @@ typedef struct {
     int AVGSRVCCASSA;
 
     int NOFPAUSE;
+    int PAUSEMINSTAFF;          // operatori che restano sempre a ogni stazione
+    int PAUSEMAXQUEUE;          // utenti in coda per operatore oltre cui niente pause
 
-    double PRICEPRIMI;
-    double PRICESECONDI;
-    double PRICECOFFEE;
+    unsigned int SEED;          // 0=casuale, altrimenti semina riproducibile dei processi
 
-    station_t st_primi;
-    station_t st_secondi;
-    station_t st_coffee;
-    station_t st_cassa;
+    int ALLOCOBJECTIVE;         // 0=minimizza attesa massima, 1=attesa totale
 
-    int tavoli_liberi;
-    sem_t sem_tavoli;
+    int LOGLEVEL;               // 0=debug, 1=info, 2=warn, 3=error, 4=off
+    char LOGFILE[128];          // file del log dei processi, "-" = stdout
 
-    char *menu_primi[MAX_PRIMI_TYPES];
-    int menu_primi_count;
+    int TRACE;                  // 1=traccia binaria degli eventi attiva
+    int TRACEMAXEVENTS;         // capacita' del file di traccia per processo
+    char TRACEDIR[128];         // directory dei file di traccia
 
-    char *menu_secondi[MAX_SECONDI_TYPES];
-    int menu_secondi_count;
+    int TIMESOURCE;             // 0=CLOCK_MONOTONIC, 1=TSC calibrato (se invariante)
 
-    char *menu_coffee[MAX_COFFEE_TYPES];
-    int menu_coffee_count;
+    int ARRIVALMODE;            // ARRIVI_INSIEME, ARRIVI_POISSON, ARRIVI_PICCO
+    int ARRIVALWINDOW;          // minuti simulati in cui arrivano gli utenti
+    int PREORDER;               // 1=richieste alle stazioni inviate in parallelo
+    int PATIENCEMEAN;           // pazienza media in coda (minuti simulati), 0=infinita
+    int BALKQUEUE;              // coda visibile oltre cui l'utente rinuncia, 0=mai
 
-    stats_t stats_tot;
-    stats_t stats_giorno;
-    sem_t sem_stats;            // mutex per accesso alle statistiche
+    int GATEMODE;               // INGRESSO_LIBERO, INGRESSO_MAX_DENTRO, INGRESSO_GETTONI
+    int GATEMAXINFLIGHT;        // utenti in mensa ammessi, 0=posti a tavola + postazioni
+    int GATEMAXQUEUE;           // utenti in coda alle stazioni oltre cui si chiude, 0=ignora
+    double GATERATE;            // gettoni per minuto simulato
+    int GATEBURST;              // gettoni massimi accumulabili
+    int GATEMAXLINE;            // coda alla porta oltre cui si respinge, 0=illimitata
 
-    int giorno_corrente;
-    int terminazione_causa; // 0=timeout, 1=overload
-    int day_barrier_count;  // Contatore per sincronizzare fine giornata
+    int GROUPWEIGHTS[GRUPPO_MAX];   // pesi delle dimensioni 1..GRUPPO_MAX dei gruppi
 
-    /* Barriera di avvio */
-    int ready_count;
-    sem_t sem_barrier;
+    int QUEUEDISCIPLINE[NUM_STATIONS];  // CODA_* per primi, secondi, coffee, cassa
+    int QUEUEAGING;             // secondi simulati di svantaggio per classe
+    int PRIORITYUSERS;          // utenti con id piu' basso trattati come personale
 
-    int simulation_running;     // 1=in corso, 0=terminata
-    sem_t sem_day_start;        // segnala inizio giornata
+    double PRICEPRIMI;
+    double PRICESECONDI;
+    double PRICECOFFEE;
 
+    int menu_shmid;             // segmento del menu (menu.h)
     int msgid_primi;
     int msgid_secondi;
     int msgid_coffee;
     int msgid_cassa;
 
+    int log_shmid;              // segmento con gli anelli di log dei processi
+    int slot_shmid;             // segmento con lo stato delle richieste in coda
+    int groups_shmid;           // segmento con gruppi e mappa dei posti
+
+    /* Calibrazione del TSC, condivisa da tutti i processi (TIMESOURCE 1) */
+    int tsc_attivo;
+    uint64_t tsc_base;          // lettura del TSC alla calibrazione
+    uint64_t tsc_base_ns;       // CLOCK_MONOTONIC corrispondente
+    uint64_t tsc_mult;          // ns per tick in virgola fissa (>> TSC_SHIFT)
+
+    /* Fin qui: configurazione, scritta solo prima dell'avvio.
+       Da qui ogni gruppo scritto durante la giornata inizia su una
+       propria linea di cache. */
+
+    /* Stato della giornata: scritto da mensa, letto da tutti */
+    int simulation_running CACHE_ALIGNED;   // 1=in corso, 0=terminata
+    int giorno_corrente;
+    uint64_t inizio_giorno_ns;  // sim_now_ns() all'apertura della giornata
+    int terminazione_causa; // 0=timeout, 1=overload
+
+    station_t st_primi;
+    station_t st_secondi;
+    station_t st_coffee;
+    station_t st_cassa;
+
+    ingresso_t ingresso CACHE_ALIGNED;
+
+    int tavoli_liberi CACHE_ALIGNED;
+    sem_t sem_tavoli;
+    lockstat_t sem_tavoli_stat;
+
+    sem_t sem_stats CACHE_ALIGNED;  // mutex per accesso alle statistiche
+    lockstat_t sem_stats_stat;
+    stats_t stats_giorno CACHE_ALIGNED;
+
+    /* Barriere di operatori e utenti, coordinate da mensa */
+    barrier_t barriera_avvio;   // processi pronti
+    barrier_t barriera_giorno;  // fine di una giornata e inizio della successiva
+
+    /* Scritti solo a fine giornata */
+    stats_t stats_tot CACHE_ALIGNED;
+    prof_counter_t prof_operatore[PROF_OP_STAGES];
+    prof_counter_t prof_utente[PROF_UT_STAGES];
 } shm_t;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Orologio simulato
+   Tutte le attese e i timestamp della simulazione passano da qui.
+   NNANOSECS e' il numero di nanosecondi reali che corrispondono a
+   un secondo simulato: un minuto simulato dura NNANOSECS*60 ns, una
+   giornata GIORNATA_MINUTI minuti. Le proporzioni fra giornata,
+   servizi, pause e pasti restano le stesse a qualunque scala.
+   --------------------------------------------------------- */
+
+#define SIM_SEC_PER_MIN     60
+#define TSC_SHIFT           32          // virgola fissa di tsc_mult
+
+/* Limiti reali delle attese di polling (controlli periodici) */
+#define SIM_POLL_MIN_NS     1000000L    // 1 ms
+#define SIM_POLL_MAX_NS     50000000L   // 50 ms
+
+long   sim_sec_to_ns(double sim_sec);
+long   sim_min_to_ns(double sim_min);
+double sim_ns_to_sec(long real_ns);
+
+void sim_sleep_ns(long real_ns);     // interrotta da sim_stop()
+void sim_sleep_sec(double sim_sec);
+void sim_sleep_min(double sim_min);
+void sim_poll(double sim_sec);
+void sim_poll_deadline(struct timespec *ts, double sim_sec);
+
+void sim_stop(void);                 // chiude la giornata e sveglia le attese
+void simclock_calibrate(shm_t *shm);
+
+extern shm_t *shm;
+
+/* ---------------------------------------------------------
+   Timestamp monotono a 64 bit in nanosecondi, usato per misurare
+   le attese. Con TIMESOURCE 1 e TSC invariante legge il contatore
+   della CPU e lo converte con la calibrazione in memoria condivisa,
+   altrimenti usa CLOCK_MONOTONIC. Non risente dei salti di NTP.
+   --------------------------------------------------------- */
+static inline uint64_t sim_now_ns(void) {
+#if defined(__x86_64__)
+    if (shm->tsc_attivo) {
+        uint64_t d = __builtin_ia32_rdtsc() - shm->tsc_base;
+        __extension__ unsigned __int128 prod = (unsigned __int128)d * shm->tsc_mult;
+        return shm->tsc_base_ns + (uint64_t)(prod >> TSC_SHIFT);
+    }
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif
@@ -5,8 +5,10 @@
 
 void stations_init(shm_t *shm);
 void stations_refill_day(shm_t *shm);
-void stations_refill_periodic(shm_t *shm);
+void stations_refill_periodic(shm_t *shm, int fascia);
+void stations_plan_refill(shm_t *shm);
 void stations_assign_workers(shm_t *shm);
 void stations_compute_leftovers(shm_t *shm);
+void stations_collect_day(shm_t *shm);
 
 #endif
\ No newline at end of file
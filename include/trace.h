@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "shared_structs.h"
+#include "simclock.h"
+
+#define TRACE_MAGIC     0x4352544DU     // "MTRC"
+#define TRACE_VERSION   3
+
+/* Tipo di processo che ha scritto il file */
+#define TRACE_PROC_OPERATORE    0
+#define TRACE_PROC_UTENTE       1
+
+/* Eventi del percorso di un utente */
+#define TR_ENQUEUE          1   // utente: richiesta inviata alla stazione
+#define TR_SERVICE_START    2   // operatore: inizio servizio
+#define TR_SERVICE_END      3   // operatore: fine servizio, risposta inviata
+#define TR_DISH_OUTCOME     4   // utente: risposta ricevuta (esito)
+#define TR_PAYMENT          5   // utente: pagamento completato
+#define TR_SEAT_ACQUIRED    6   // utente: posto a tavola acquisito
+#define TR_SEAT_RELEASED    7   // utente: posto a tavola liberato
+
+/* Record a dimensione fissa (16 byte); id utente e piatto come nei messaggi */
+typedef struct {
+    uint64_t ts_ns;         // sim_now_ns(), come t_arrivo_ns
+    uint32_t user_id : 20;
+    uint32_t piatto  : 12;
+    uint8_t  event;
+    uint8_t  station;       // 0=primi, 1=secondi, 2=coffee, 3=cassa
+    uint8_t  esito;
+    uint8_t  riservato;
+} trace_rec_t;
+
+/* Intestazione del file, seguita da capacity record */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;
+    int32_t  proc_kind;
+    int32_t  proc_id;
+    uint64_t capacity;
+    volatile uint64_t count;    // record validi (aggiornato dopo ogni scrittura)
+    uint64_t dropped;           // eventi persi a file pieno
+    uint64_t reserved;
+} trace_hdr_t;
+
+extern trace_hdr_t *trace_hdr;
+extern trace_rec_t *trace_recs;
+
+void trace_open(shm_t *shm, int proc_kind, int proc_id);
+void trace_close(void);
+
+/* Registra un evento: con la traccia disabilitata costa un solo confronto */
+static inline void trace_event(int event, int user_id, int station, int esito, int piatto) {
+    if (trace_hdr == NULL)
+        return;
+
+    uint64_t n = trace_hdr->count;
+    if (n >= trace_hdr->capacity) {
+        trace_hdr->dropped++;
+        return;
+    }
+
+    trace_rec_t *r = &trace_recs[n];
+    r->ts_ns   = sim_now_ns();
+    r->user_id = (uint32_t)user_id;
+    r->piatto  = (uint32_t)piatto;
+    r->event   = (uint8_t)event;
+    r->station = (uint8_t)station;
+    r->esito   = (uint8_t)esito;
+    r->riservato = 0;
+
+    trace_hdr->count = n + 1;
+}
+
+#endif
@@ -2,6 +2,5 @@
 #define UTIL_H
 
 int rand_range(int min, int max);
-void nanosleep_ms(int ms);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <time.h>
+#include "shared_structs.h"
+#include "barrier.h"
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void barrier_init(barrier_t *b, int partecipanti) {
+    b->partecipanti = partecipanti;
+    b->arrivati     = 0;
+    b->generazione  = 0;
+}
+
+void barrier_wait(barrier_t *b) {
+    /* La generazione va letta prima di arrivare: dopo l'ultimo arrivo
+       il coordinatore puo' gia' aprire */
+    uint32_t g = __atomic_load_n(&b->generazione, __ATOMIC_ACQUIRE);
+
+    if (__atomic_add_fetch(&b->arrivati, 1, __ATOMIC_ACQ_REL) == (uint32_t)b->partecipanti)
+        futex_wake(&b->arrivati, INT_MAX);
+
+    while (__atomic_load_n(&b->generazione, __ATOMIC_ACQUIRE) == g)
+        futex_wait(&b->generazione, g, NULL);
+}
+
+int barrier_collect(barrier_t *b, long timeout_ns) {
+    long scadenza = now_ns() + timeout_ns;
+    uint32_t n;
+
+    while ((n = __atomic_load_n(&b->arrivati, __ATOMIC_ACQUIRE)) < (uint32_t)b->partecipanti) {
+        long resto = scadenza - now_ns();
+        if (resto <= 0)
+            return -1;
+
+        struct timespec ts = { resto / 1000000000L, resto % 1000000000L };
+        futex_wait(&b->arrivati, n, &ts);
+    }
+    return 0;
+}
+
+void barrier_open(barrier_t *b) {
+    __atomic_store_n(&b->arrivati, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&b->generazione, 1, __ATOMIC_ACQ_REL);
+    futex_wake(&b->generazione, INT_MAX);
+}
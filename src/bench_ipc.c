@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Microbenchmark dei meccanismi di passaggio richiesta/risposta
+   tra utente e operatore, con le dimensioni reali di
+   msg_request_t / msg_response_t:
+   - msgq:      msgsnd/msgrcv su una coda condivisa (richiesta con
+                mtype 1, risposta con MTYPE_RISPOSTA(id), come in
+                go_to_station() / serve_user())
+   - sem:       coppia di sem_t process-shared (come st->mutex)
+   - timedwait: come sem ma attesa con sem_timedwait (come i tavoli)
+   - spin:      slot in memoria condivisa con attesa attiva
+   Ogni meccanismo viene eseguito con 1, 2, 4 e N coppie concorrenti
+   (N = numero di CPU).
+
+   Uso: bench_ipc [-n iterazioni] [-p coppie_max]
+   --------------------------------------------------------- */
+
+#define MECH_MSGQ       0
+#define MECH_SEM        1
+#define MECH_TIMEDWAIT  2
+#define MECH_SPIN       3
+#define NUM_MECH        4
+
+#define MAX_PAIRS       256
+#define SPIN_YIELD      1024    // cede la CPU ogni N giri (macchine sovraccariche)
+
+static const char *mech_names[NUM_MECH] = { "msgq", "sem", "timedwait", "spin" };
+
+/* Canale di una coppia utente/operatore in memoria condivisa */
+typedef struct {
+    sem_t req_ready;
+    sem_t res_ready;
+    volatile int req_seq;
+    volatile int res_seq;
+    msg_request_t  req;
+    msg_response_t res;
+    char pad[64];
+} channel_t;
+
+typedef struct {
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double elapsed_s;
+} pair_result_t;
+
+typedef struct {
+    volatile int go;
+    channel_t ch[MAX_PAIRS];
+    pair_result_t result[MAX_PAIRS];
+} bench_shm_t;
+
+static bench_shm_t *bs;
+static int msgid = -1;
+static int iterations = 20000;
+
+static inline long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void wait_go(void) {
+    while (!__atomic_load_n(&bs->go, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static void timed_wait(sem_t *s) {
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 100000000; // 100ms, come per i tavoli
+    if (timeout.tv_nsec >= 1000000000) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(s, &timeout) < 0 && (errno == ETIMEDOUT || errno == EINTR))
+        ;
+}
+
+static void spin_until(volatile int *seq, int value) {
+    int spins = 0;
+    while (__atomic_load_n(seq, __ATOMIC_ACQUIRE) != value) {
+        if (++spins % SPIN_YIELD == 0)
+            sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+/* Lato operatore: riceve una richiesta e risponde */
+static void server(int mech, int id) {
+    channel_t *ch = &bs->ch[id];
+    msg_request_t req;
+    msg_response_t res;
+
+    wait_go();
+
+    for (int i = 0; i < iterations; i++) {
+        switch (mech) {
+            case MECH_MSGQ:
+                if (msgrcv(msgid, &req, MSG_REQ_SIZE, 1, 0) < 0) {
+                    perror("[BENCH_IPC] msgrcv server");
+                    _exit(EXIT_FAILURE);
+                }
+                memset(&res, 0, sizeof(res));
+                res.mtype = MTYPE_RISPOSTA(req.user_id);
+                res.user_id = req.user_id;
+                if (msgsnd(msgid, &res, MSG_RES_SIZE, 0) < 0) {
+                    perror("[BENCH_IPC] msgsnd server");
+                    _exit(EXIT_FAILURE);
+                }
+                break;
+
+            case MECH_SEM:
+            case MECH_TIMEDWAIT:
+                if (mech == MECH_SEM)
+                    sem_wait(&ch->req_ready);
+                else
+                    timed_wait(&ch->req_ready);
+                ch->res.user_id = ch->req.user_id;
+                ch->res.esito = 0;
+                sem_post(&ch->res_ready);
+                break;
+
+            case MECH_SPIN:
+                spin_until(&ch->req_seq, i + 1);
+                ch->res.user_id = ch->req.user_id;
+                ch->res.esito = 0;
+                __atomic_store_n(&ch->res_seq, i + 1, __ATOMIC_RELEASE);
+                break;
+        }
+    }
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Lato utente: invia la richiesta e misura il tempo di andata e ritorno */
+static void client(int mech, int id) {
+    channel_t *ch = &bs->ch[id];
+    msg_request_t req;
+    msg_response_t res;
+    long *samples = malloc(sizeof(long) * iterations);
+
+    memset(&req, 0, sizeof(req));
+    req.mtype = 1;
+    req.user_id = id;
+
+    wait_go();
+    long t_start = now_ns();
+
+    for (int i = 0; i < iterations; i++) {
+        long t0 = now_ns();
+
+        switch (mech) {
+            case MECH_MSGQ:
+                req.t_arrivo_ns = now_ns();
+                if (msgsnd(msgid, &req, MSG_REQ_SIZE, 0) < 0) {
+                    perror("[BENCH_IPC] msgsnd client");
+                    _exit(EXIT_FAILURE);
+                }
+                if (msgrcv(msgid, &res, MSG_RES_SIZE, MTYPE_RISPOSTA(id), 0) < 0) {
+                    perror("[BENCH_IPC] msgrcv client");
+                    _exit(EXIT_FAILURE);
+                }
+                break;
+
+            case MECH_SEM:
+            case MECH_TIMEDWAIT:
+                req.t_arrivo_ns = now_ns();
+                ch->req = req;
+                sem_post(&ch->req_ready);
+                if (mech == MECH_SEM)
+                    sem_wait(&ch->res_ready);
+                else
+                    timed_wait(&ch->res_ready);
+                res = ch->res;
+                break;
+
+            case MECH_SPIN:
+                req.t_arrivo_ns = now_ns();
+                ch->req = req;
+                __atomic_store_n(&ch->req_seq, i + 1, __ATOMIC_RELEASE);
+                spin_until(&ch->res_seq, i + 1);
+                res = ch->res;
+                break;
+        }
+
+        samples[i] = now_ns() - t0;
+    }
+
+    long t_end = now_ns();
+    (void)res;
+
+    long sum = 0;
+    for (int i = 0; i < iterations; i++)
+        sum += samples[i];
+    qsort(samples, iterations, sizeof(long), cmp_long);
+
+    bs->result[id].mean_ns   = (double)sum / iterations;
+    bs->result[id].p50_ns    = samples[iterations / 2];
+    bs->result[id].p99_ns    = samples[(int)(iterations * 0.99)];
+    bs->result[id].elapsed_s = (t_end - t_start) / 1e9;
+
+    free(samples);
+}
+
+static void run(int mech, int pairs) {
+    memset(bs, 0, sizeof(*bs));
+    for (int i = 0; i < pairs; i++) {
+        sem_init(&bs->ch[i].req_ready, 1, 0);
+        sem_init(&bs->ch[i].res_ready, 1, 0);
+    }
+
+    if (mech == MECH_MSGQ) {
+        msgid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+        if (msgid < 0) {
+            perror("[BENCH_IPC] msgget");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < pairs; i++) {
+        if (fork() == 0) {
+            server(mech, i);
+            _exit(EXIT_SUCCESS);
+        }
+        if (fork() == 0) {
+            client(mech, i);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    __atomic_store_n(&bs->go, 1, __ATOMIC_RELEASE);
+    while (wait(NULL) > 0)
+        ;
+
+    if (mech == MECH_MSGQ)
+        msgctl(msgid, IPC_RMID, NULL);
+    for (int i = 0; i < pairs; i++) {
+        sem_destroy(&bs->ch[i].req_ready);
+        sem_destroy(&bs->ch[i].res_ready);
+    }
+
+    double mean = 0, p50 = 0, p99 = 0, max_elapsed = 0;
+    for (int i = 0; i < pairs; i++) {
+        mean += bs->result[i].mean_ns;
+        p50  += bs->result[i].p50_ns;
+        if (bs->result[i].p99_ns > p99)
+            p99 = bs->result[i].p99_ns;
+        if (bs->result[i].elapsed_s > max_elapsed)
+            max_elapsed = bs->result[i].elapsed_s;
+    }
+    mean /= pairs;
+    p50  /= pairs;
+
+    double throughput = max_elapsed > 0 ? (double)pairs * iterations / max_elapsed : 0;
+
+    printf("%-10s %6d %12.0f %12.0f %12.0f %14.0f\n",
+           mech_names[mech], pairs, mean, p50, p99, throughput);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    int max_pairs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atoi(optarg); break;
+            case 'p': max_pairs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Uso: bench_ipc [-n iterazioni] [-p coppie_max]\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (iterations < 100)
+        iterations = 100;
+    if (max_pairs < 1)
+        max_pairs = 1;
+    if (max_pairs > MAX_PAIRS)
+        max_pairs = MAX_PAIRS;
+
+    bs = mmap(NULL, sizeof(bench_shm_t), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (bs == MAP_FAILED) {
+        perror("[BENCH_IPC] mmap");
+        return EXIT_FAILURE;
+    }
+
+    /* 1, 2, 4 coppie fino a max_pairs, poi max_pairs se non gia' presente */
+    int pair_counts[4];
+    int n_counts = 0;
+    for (int p = 1; p <= 4 && p <= max_pairs; p *= 2)
+        pair_counts[n_counts++] = p;
+    if (pair_counts[n_counts - 1] != max_pairs)
+        pair_counts[n_counts++] = max_pairs;
+
+    printf("[BENCH_IPC] richiesta %zu byte, risposta %zu byte, %d iterazioni per coppia\n",
+           MSG_REQ_SIZE, MSG_RES_SIZE, iterations);
+    printf("%-10s %6s %12s %12s %12s %14s\n",
+           "meccanismo", "coppie", "media ns", "p50 ns", "p99 ns", "round trip/s");
+
+    for (int m = 0; m < NUM_MECH; m++) {
+        for (int c = 0; c < n_counts; c++)
+            run(m, pair_counts[c]);
+    }
+
+    munmap(bs, sizeof(bench_shm_t));
+    return EXIT_SUCCESS;
+}
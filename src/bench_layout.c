@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "shared_structs.h"
+
+/* ---------------------------------------------------------
+   Microbenchmark della disposizione di shm_t in linee di cache.
+   N processi ripetono le operazioni che utenti e operatori fanno
+   su memoria condivisa per ogni richiesta, ciascuno sulla stazione
+   id % NUM_STATIONS:
+   - incremento atomico di utenti_in_coda e del contatore delle
+     richieste della stazione (utente che entra in coda)
+   - ogni PASSI_MUTEX giri, mutex della stazione con un campo protetto
+     (operatore che prende le porzioni)
+   - decremento atomico di utenti_in_coda (operatore che serve)
+   Si confronta la disposizione compatta precedente (stazioni
+   adiacenti, contatori delle richieste di tutte le stazioni vicini)
+   con quella di shm_t, in cui il contatore delle richieste sta sulla
+   linea della coda della propria stazione, con 1, 2, 4, ... fino a -p
+   processi, il processo i fissato sulla CPU i % ncpu. Prima dei tempi
+   si stampa quante linee di cache sono scritte da piu' stazioni in
+   ciascuna disposizione, che non dipende dal numero di core.
+
+   Uso: bench_layout [-n iterazioni] [-p processi_max]
+   --------------------------------------------------------- */
+
+#define LAYOUT_COMPATTO     0
+#define LAYOUT_ALLINEATO    1
+#define NUM_LAYOUT          2
+
+#define MAX_PROC            512
+#define PASSI_MUTEX         16      // una sezione critica ogni N richieste
+
+/* station_t prima della separazione in linee di cache */
+typedef struct {
+    int postazioni_totali;
+    int postazioni_occupate;
+    long tempo_attesa_totale_ns;
+    int utenti_serviti;
+    int utenti_in_coda;
+    int msgid;
+    sem_t mutex;
+    lockstat_t mutex_stat;
+} station_compatta_t;
+
+typedef struct {
+    station_compatta_t st[NUM_STATIONS];
+    int richieste[NUM_STATIONS];
+} layout_compatto_t;
+
+typedef struct {
+    volatile int go;
+    double elapsed_s[MAX_PROC];
+    union {
+        layout_compatto_t compatto;
+        shm_t allineato;
+    } l;
+} bench_shm_t;
+
+static bench_shm_t *bs;
+static int iterations = 2000000;
+
+static inline long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Puntatori ai campi usati da un processo nella disposizione scelta */
+typedef struct {
+    int *in_coda;
+    int *richieste;
+    int *protetto;
+    sem_t *mutex;
+} campi_t;
+
+static station_t *aligned_station(int s) {
+    switch (s) {
+        case 0: return &bs->l.allineato.st_primi;
+        case 1: return &bs->l.allineato.st_secondi;
+        case 2: return &bs->l.allineato.st_coffee;
+    }
+    return &bs->l.allineato.st_cassa;
+}
+
+static campi_t get_fields(int layout, int s) {
+    campi_t c;
+    if (layout == LAYOUT_COMPATTO) {
+        station_compatta_t *st = &bs->l.compatto.st[s];
+        c.in_coda   = &st->utenti_in_coda;
+        c.richieste = &bs->l.compatto.richieste[s];
+        c.protetto  = &st->postazioni_occupate;
+        c.mutex     = &st->mutex;
+    } else {
+        station_t *st = aligned_station(s);
+        c.in_coda   = &st->utenti_in_coda;
+        c.richieste = &st->richieste;
+        c.protetto  = &st->postazioni_occupate;
+        c.mutex     = &st->mutex;
+    }
+    return c;
+}
+
+/* Linee di cache scritte da processi di stazioni diverse */
+static int shared_lines(int layout) {
+    uintptr_t linee[NUM_STATIONS][5];
+    int condivise = 0;
+
+    for (int s = 0; s < NUM_STATIONS; s++) {
+        campi_t c = get_fields(layout, s);
+        linee[s][0] = (uintptr_t)c.in_coda / CACHE_LINE;
+        linee[s][1] = (uintptr_t)c.richieste / CACHE_LINE;
+        linee[s][2] = (uintptr_t)c.protetto / CACHE_LINE;
+        linee[s][3] = (uintptr_t)c.mutex / CACHE_LINE;
+        linee[s][4] = ((uintptr_t)(c.mutex + 1) - 1) / CACHE_LINE;
+    }
+
+    for (int s = 0; s < NUM_STATIONS; s++)
+        for (int i = 0; i < 5; i++) {
+            int altra = 0, prima = 1;
+            for (int t = 0; t < NUM_STATIONS; t++)
+                for (int j = 0; j < 5; j++) {
+                    if (linee[t][j] != linee[s][i])
+                        continue;
+                    if (t != s)
+                        altra = 1;
+                    if (t < s || (t == s && j < i))
+                        prima = 0;      // linea gia' contata
+                }
+            condivise += altra && prima;
+        }
+    return condivise;
+}
+
+static void worker(int layout, int id) {
+    campi_t c = get_fields(layout, id % NUM_STATIONS);
+    int ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ncpu > 1) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(id % ncpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    while (!__atomic_load_n(&bs->go, __ATOMIC_ACQUIRE))
+        sched_yield();
+
+    long t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        __sync_fetch_and_add(c.in_coda, 1);
+        __sync_fetch_and_add(c.richieste, 1);
+        if (i % PASSI_MUTEX == 0) {
+            sem_wait(c.mutex);
+            (*c.protetto)++;
+            sem_post(c.mutex);
+        }
+        __sync_fetch_and_sub(c.in_coda, 1);
+    }
+    bs->elapsed_s[id] = (now_ns() - t0) / 1e9;
+}
+
+static double run(int layout, int procs) {
+    memset(bs, 0, sizeof(*bs));
+    for (int s = 0; s < NUM_STATIONS; s++)
+        sem_init(get_fields(layout, s).mutex, 1, 1);
+
+    for (int i = 0; i < procs; i++) {
+        if (fork() == 0) {
+            worker(layout, i);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    __atomic_store_n(&bs->go, 1, __ATOMIC_RELEASE);
+    while (wait(NULL) > 0)
+        ;
+
+    for (int s = 0; s < NUM_STATIONS; s++)
+        sem_destroy(get_fields(layout, s).mutex);
+
+    double max_elapsed = 0;
+    for (int i = 0; i < procs; i++)
+        if (bs->elapsed_s[i] > max_elapsed)
+            max_elapsed = bs->elapsed_s[i];
+
+    return max_elapsed > 0 ? (double)procs * iterations / max_elapsed : 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_procs = ncpu * 2;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atoi(optarg); break;
+            case 'p': max_procs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Uso: bench_layout [-n iterazioni] [-p processi_max]\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (iterations < 1000)
+        iterations = 1000;
+    if (max_procs < 1)
+        max_procs = 1;
+    if (max_procs > MAX_PROC)
+        max_procs = MAX_PROC;
+
+    bs = mmap(NULL, sizeof(bench_shm_t), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (bs == MAP_FAILED) {
+        perror("[BENCH_LAYOUT] mmap");
+        return EXIT_FAILURE;
+    }
+
+    printf("[BENCH_LAYOUT] station_t compatta %zu byte, allineata %zu byte; "
+           "%d iterazioni per processo, %d CPU\n",
+           sizeof(station_compatta_t), sizeof(station_t), iterations, ncpu);
+    printf("[BENCH_LAYOUT] linee di cache scritte da piu' stazioni: compatto %d, allineato %d\n",
+           shared_lines(LAYOUT_COMPATTO), shared_lines(LAYOUT_ALLINEATO));
+    if (ncpu < 2)
+        printf("[BENCH_LAYOUT] una sola CPU: i processi si alternano e il false sharing "
+               "non si manifesta, i tempi non misurano il guadagno\n");
+    printf("%8s %16s %16s %10s\n", "processi",
+           "compatto op/s", "allineato op/s", "guadagno");
+
+    for (int procs = 1; procs <= max_procs; procs *= 2) {
+        double tp[NUM_LAYOUT];
+        for (int l = 0; l < NUM_LAYOUT; l++)
+            tp[l] = run(l, procs);
+        printf("%8d %16.0f %16.0f %9.2fx\n", procs, tp[LAYOUT_COMPATTO],
+               tp[LAYOUT_ALLINEATO],
+               tp[LAYOUT_COMPATTO] > 0 ? tp[LAYOUT_ALLINEATO] / tp[LAYOUT_COMPATTO] : 0.0);
+        fflush(stdout);
+    }
+
+    munmap(bs, sizeof(bench_shm_t));
+    return EXIT_SUCCESS;
+}
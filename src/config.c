@@ -5,6 +5,7 @@
 #include <ctype.h>
 #include "shared_structs.h"
 #include "config.h"
+#include "menu.h"
 
 
 extern shm_t *shm;
@@ -20,12 +21,88 @@ static int is_only_whitespace(const char *str) {
     return 1;
 }
 
+/* GROUPWEIGHTS p1,p2,...: pesi delle dimensioni 1..GRUPPO_MAX */
+static void parse_group_weights(char *str) {
+    int somma = 0;
+    char *save = NULL;
+    char *tok = strtok_r(str, ",", &save);
+
+    memset(shm->GROUPWEIGHTS, 0, sizeof(shm->GROUPWEIGHTS));
+    for (int i = 0; i < GRUPPO_MAX && tok != NULL; i++) {
+        shm->GROUPWEIGHTS[i] = atoi(tok) > 0 ? atoi(tok) : 0;
+        somma += shm->GROUPWEIGHTS[i];
+        tok = strtok_r(NULL, ",", &save);
+    }
+
+    if (somma == 0) {
+        printf("[CONFIG] GROUPWEIGHTS senza pesi positivi, solo utenti singoli\n");
+        shm->GROUPWEIGHTS[0] = 1;
+    }
+}
+
+/* ---------------------------------------------------------
+   QUEUEDISCIPLINE d o d1,d2,d3,d4: disciplina di tutte le stazioni
+   o di primi, secondi, coffee e cassa (0=FIFO, 1=SJF, 2=priorita')
+   --------------------------------------------------------- */
+static void parse_queue_discipline(char *str) {
+    char *save = NULL;
+    char *tok = strtok_r(str, ",", &save);
+    int d = 0;
+
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        if (tok != NULL) {
+            d = atoi(tok);
+            if (d < CODA_FIFO || d > CODA_PRIORITA) {
+                printf("[CONFIG] QUEUEDISCIPLINE %d non valida, uso FIFO\n", d);
+                d = CODA_FIFO;
+            }
+            tok = strtok_r(NULL, ",", &save);
+        }
+        shm->QUEUEDISCIPLINE[i] = d;    // un solo valore vale per tutte
+    }
+}
+
 int load_config(void) {
     return load_config_from_file("config.txt");
 }
 
+/* Valori di default dei parametri opzionali */
+static void config_set_defaults(void) {
+    shm->SEED = 0;
+    shm->ALLOCOBJECTIVE = 0;
+    shm->LOGLEVEL = 1;
+    strcpy(shm->LOGFILE, "mensa.log");
+    shm->TRACE = 0;
+    shm->TRACEMAXEVENTS = 65536;
+    strcpy(shm->TRACEDIR, "trace");
+    shm->TIMESOURCE = 0;
+    shm->ARRIVALMODE = ARRIVI_INSIEME;
+    shm->ARRIVALWINDOW = 180;
+    shm->PREORDER = 0;
+    shm->PATIENCEMEAN = 0;
+    shm->BALKQUEUE = 0;
+    shm->PAUSEMINSTAFF = 1;
+    shm->REFILLPLAN = 0;
+    shm->PLANSOLDOUTCOST = 3;
+    shm->PLANLEFTOVERCOST = 1;
+    shm->PAUSEMAXQUEUE = 2;
+    shm->GATEMODE = INGRESSO_LIBERO;
+    shm->GATEMAXINFLIGHT = 0;
+    shm->GATEMAXQUEUE = 0;
+    shm->GATERATE = 1.0;
+    shm->GATEBURST = 5;
+    shm->GATEMAXLINE = 0;
+    memset(shm->GROUPWEIGHTS, 0, sizeof(shm->GROUPWEIGHTS));
+    shm->GROUPWEIGHTS[0] = 1;       // solo utenti singoli
+    memset(shm->QUEUEDISCIPLINE, 0, sizeof(shm->QUEUEDISCIPLINE));   // FIFO
+    shm->QUEUEAGING = 60;
+    shm->PRIORITYUSERS = 0;
+}
+
 int load_config_from_file(const char *filename) {
 
+    config_set_defaults();
+
     FILE *f = fopen(filename, "r");
     if (!f) {
         fprintf(stderr, "[CONFIG] Impossibile aprire %s\n", filename);
@@ -44,6 +121,27 @@ int load_config_from_file(const char *filename) {
             continue;
         }
         
+        /* Parametri stringa */
+        char svalue[128];
+        if (sscanf(line, "%63s %127s", key, svalue) == 2) {
+            if (strcmp(key, "LOGFILE") == 0) {
+                strcpy(shm->LOGFILE, svalue);
+                continue;
+            }
+            else if (strcmp(key, "TRACEDIR") == 0) {
+                strcpy(shm->TRACEDIR, svalue);
+                continue;
+            }
+            else if (strcmp(key, "GROUPWEIGHTS") == 0) {
+                parse_group_weights(svalue);
+                continue;
+            }
+            else if (strcmp(key, "QUEUEDISCIPLINE") == 0) {
+                parse_queue_discipline(svalue);
+                continue;
+            }
+        }
+
         double dvalue;
         if (sscanf(line, "%63s %lf", key, &dvalue) == 2) {
             if (strcmp(key, "PRICEPRIMI") == 0) {
@@ -58,6 +156,10 @@ int load_config_from_file(const char *filename) {
                 shm->PRICECOFFEE = dvalue;
                 continue;
             }
+            else if (strcmp(key, "GATERATE") == 0) {
+                shm->GATERATE = dvalue;
+                continue;
+            }
             
             long value = (long)dvalue;
 
@@ -116,6 +218,68 @@ int load_config_from_file(const char *filename) {
 
         else if (strcmp(key, "NOFPAUSE") == 0)
             shm->NOFPAUSE = value;
+        else if (strcmp(key, "REFILLPLAN") == 0)
+            shm->REFILLPLAN = value;
+        else if (strcmp(key, "PLANSOLDOUTCOST") == 0)
+            shm->PLANSOLDOUTCOST = value;
+        else if (strcmp(key, "PLANLEFTOVERCOST") == 0)
+            shm->PLANLEFTOVERCOST = value;
+        else if (strcmp(key, "PAUSEMINSTAFF") == 0)
+            shm->PAUSEMINSTAFF = value;
+        else if (strcmp(key, "PAUSEMAXQUEUE") == 0)
+            shm->PAUSEMAXQUEUE = value;
+        else if (strcmp(key, "QUEUEAGING") == 0)
+            shm->QUEUEAGING = value;
+        else if (strcmp(key, "PRIORITYUSERS") == 0)
+            shm->PRIORITYUSERS = value;
+
+        else if (strcmp(key, "SEED") == 0)
+            shm->SEED = value;
+
+        else if (strcmp(key, "ALLOCOBJECTIVE") == 0)
+            shm->ALLOCOBJECTIVE = value;
+
+        else if (strcmp(key, "LOGLEVEL") == 0)
+            shm->LOGLEVEL = value;
+
+        else if (strcmp(key, "TRACE") == 0)
+            shm->TRACE = value;
+
+        else if (strcmp(key, "TRACEMAXEVENTS") == 0)
+            shm->TRACEMAXEVENTS = value;
+
+        else if (strcmp(key, "TIMESOURCE") == 0)
+            shm->TIMESOURCE = value;
+
+        else if (strcmp(key, "ARRIVALMODE") == 0)
+            shm->ARRIVALMODE = value;
+
+        else if (strcmp(key, "ARRIVALWINDOW") == 0)
+            shm->ARRIVALWINDOW = value;
+
+        else if (strcmp(key, "PREORDER") == 0)
+            shm->PREORDER = value;
+
+        else if (strcmp(key, "PATIENCEMEAN") == 0)
+            shm->PATIENCEMEAN = value;
+
+        else if (strcmp(key, "BALKQUEUE") == 0)
+            shm->BALKQUEUE = value;
+
+        else if (strcmp(key, "GATEMODE") == 0)
+            shm->GATEMODE = value;
+
+        else if (strcmp(key, "GATEMAXINFLIGHT") == 0)
+            shm->GATEMAXINFLIGHT = value;
+
+        else if (strcmp(key, "GATEMAXQUEUE") == 0)
+            shm->GATEMAXQUEUE = value;
+
+        else if (strcmp(key, "GATEBURST") == 0)
+            shm->GATEBURST = value;
+
+        else if (strcmp(key, "GATEMAXLINE") == 0)
+            shm->GATEMAXLINE = value;
 
         else {
             printf("[CONFIG] Parametro sconosciuto: %s\n", key);
@@ -124,89 +288,98 @@ int load_config_from_file(const char *filename) {
     }
 
     fclose(f);
+
+    if (shm->NOFUSERS >= MSG_MAX_UTENTI) {
+        printf("[CONFIG] NOFUSERS %d oltre il limite dei messaggi, uso %d\n",
+               shm->NOFUSERS, MSG_MAX_UTENTI - 1);
+        shm->NOFUSERS = MSG_MAX_UTENTI - 1;
+    }
+
+    if (shm->ARRIVALMODE < ARRIVI_INSIEME || shm->ARRIVALMODE > ARRIVI_PICCO) {
+        printf("[CONFIG] ARRIVALMODE %d fuori da %d..%d, uso %d (insieme)\n",
+               shm->ARRIVALMODE, ARRIVI_INSIEME, ARRIVI_PICCO, ARRIVI_INSIEME);
+        shm->ARRIVALMODE = ARRIVI_INSIEME;
+    }
+
+    if (shm->ARRIVALWINDOW <= 0 || shm->ARRIVALWINDOW > GIORNATA_MINUTI) {
+        printf("[CONFIG] ARRIVALWINDOW %d fuori da 1..%d, uso %d\n",
+               shm->ARRIVALWINDOW, GIORNATA_MINUTI, GIORNATA_MINUTI);
+        shm->ARRIVALWINDOW = GIORNATA_MINUTI;
+    }
+
     return 0;
 }
 
+/* Aggiunge i piatti di una riga del menu alla lista di una portata */
+static void parse_dishes(char *lista, char ***nomi, int *count, int *cap) {
+    for (char *tok = strtok(lista, ",\n"); tok; tok = strtok(NULL, ",\n")) {
+        if (is_only_whitespace(tok))
+            continue;
+
+        while (isspace((unsigned char)*tok))
+            tok++;
+        char *fine = tok + strlen(tok);
+        while (fine > tok && isspace((unsigned char)fine[-1]))
+            *--fine = '\0';
+
+        if (*count == *cap) {
+            *cap = *cap ? *cap * 2 : 8;
+            *nomi = realloc(*nomi, *cap * sizeof(char *));
+            if (!*nomi) {
+                perror("[CONFIG] realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        (*nomi)[(*count)++] = strdup(tok);
+    }
+}
+
+/* ---------------------------------------------------------
+   Lettura di menu.txt: righe di lunghezza e piatti in numero
+   qualsiasi (fino a MENU_MAX_PIATTI per portata); i nomi sono
+   copiati nel segmento del menu e le copie locali liberate
+   --------------------------------------------------------- */
 int load_menu(void) {
-    /* Inizializza contatori a zero */
-    shm->menu_primi_count = 0;
-    shm->menu_secondi_count = 0;
-    shm->menu_coffee_count = 0;
-    
+    static const char *prefissi[NUM_PORTATE] = { "PRIMI:", "SECONDI:", "COFFEE:" };
+    static const char *mancanti[NUM_PORTATE] = { "i primi", "i secondi", "i caffe" };
+    char **nomi[NUM_PORTATE] = { NULL, NULL, NULL };
+    int count[NUM_PORTATE] = { 0, 0, 0 };
+    int cap[NUM_PORTATE] = { 0, 0, 0 };
+    int ret = 0;
+
     FILE *f = fopen("menu.txt", "r");
     if (!f) {
         perror("[CONFIG] Impossibile aprire menu.txt");
         return -1;
     }
 
-    char line[256];
-    while (fgets(line, sizeof(line), f)) {
-        if (strncmp(line, "PRIMI:", 6) == 0) {
-            int count = 0;
-            char *tok = strtok(line + 6, ",\n");
-            while (tok && count < MAX_PRIMI_TYPES) {
-                if (!is_only_whitespace(tok)) {
-                    shm->menu_primi[count++] = strdup(tok);
-                }
-                tok = strtok(NULL, ",\n");
-            }
-            if(count == 0) {
-                fprintf(stderr, "[CONFIG] ERRORE: Nessun piatto primo nel menu!\n");
-                fclose(f);
-                return -1;
-            }
-            shm->menu_primi_count = count;
-        }
-
-        else if (strncmp(line, "SECONDI:", 8) == 0) {
-            int count = 0;
-            char *tok = strtok(line + 8, ",\n");
-            while (tok && count < MAX_SECONDI_TYPES) {
-                if (!is_only_whitespace(tok)) {
-                    shm->menu_secondi[count++] = strdup(tok);
-                }
-                tok = strtok(NULL, ",\n");
-            }
-            if(count == 0) {
-                fprintf(stderr, "[CONFIG] Errore: nessun piatto secondo nel menu\n");
-                fclose(f);
-                return -1;
-            }
-            shm->menu_secondi_count = count;
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, f) != -1) {
+        for (int p = 0; p < NUM_PORTATE; p++) {
+            size_t n = strlen(prefissi[p]);
+            if (strncmp(line, prefissi[p], n) == 0)
+                parse_dishes(line + n, &nomi[p], &count[p], &cap[p]);
         }
+    }
+    free(line);
+    fclose(f);
 
-        else if (strncmp(line, "COFFEE:", 7) == 0) {
-            int count = 0;
-            char *tok = strtok(line + 7, ",\n");
-            while (tok && count < 4) {
-                if (!is_only_whitespace(tok)) {
-                    shm->menu_coffee[count++] = strdup(tok);
-                }
-                tok = strtok(NULL, ",\n");
-            }
-            if(count == 0) {
-                fprintf(stderr, "[CONFIG] Errore: nessun caffè/dolce nel menu\n");
-                fclose(f);
-                return -1;
-            }
-            shm->menu_coffee_count = count;
+    for (int p = 0; p < NUM_PORTATE && ret == 0; p++) {
+        if (count[p] == 0) {
+            fprintf(stderr, "[CONFIG] Errore: menu non valido - mancano %s\n", mancanti[p]);
+            ret = -1;
         }
     }
 
-    fclose(f);
-    
-    if (shm->menu_primi_count == 0) {
-        fprintf(stderr, "[CONFIG] Errore: menu non valido - mancano i primi\n");
-        return -1;
-    }
-    if (shm->menu_secondi_count == 0) {
-        fprintf(stderr, "[CONFIG] Errore: menu non valido - mancano i secondi\n");
-        return -1;
-    }
-    if (shm->menu_coffee_count== 0) {
-        fprintf(stderr, "[CONFIG] Errore: menu non valido - mancano i caffe\n");
-        return -1;
+    if (ret == 0)
+        ret = menu_create(shm, nomi, count);
+
+    for (int p = 0; p < NUM_PORTATE; p++) {
+        for (int i = 0; i < count[p]; i++)
+            free(nomi[p][i]);
+        free(nomi[p]);
     }
-    
-    return 0;
-}
\ No newline at end of file
+
+    return ret;
+}
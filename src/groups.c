@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "shared_structs.h"
+#include "ipc.h"
+#include "groups.h"
+#include "lockprof.h"
+
+static groups_shm_t *groups_seg = NULL;
+static unsigned char *posti = NULL;     // 1 = posto occupato
+static int groups_owner = 0;
+
+static size_t groups_segment_size(int utenti, int num_posti) {
+    return sizeof(groups_shm_t) + (size_t)utenti * sizeof(gruppo_t) + (size_t)num_posti;
+}
+
+static void map_segment(shm_t *shm) {
+    groups_seg = ipc_segment_attach(shm->groups_shmid, "gruppi");
+    posti = (unsigned char *)&groups_seg->gruppo[groups_seg->num_utenti];
+}
+
+/* Dimensione estratta con probabilita' proporzionale a GROUPWEIGHTS */
+static int draw_size(shm_t *shm, unsigned int *seed) {
+    int somma = 0;
+    for (int i = 0; i < GRUPPO_MAX; i++)
+        somma += shm->GROUPWEIGHTS[i];
+
+    int r = rand_r(seed) % somma;
+    for (int i = 0; i < GRUPPO_MAX; i++) {
+        if (r < shm->GROUPWEIGHTS[i])
+            return i + 1;
+        r -= shm->GROUPWEIGHTS[i];
+    }
+    return 1;
+}
+
+/* Gruppi attivi se almeno un peso riguarda gruppi di 2 o piu' utenti */
+int groups_enabled(shm_t *shm) {
+    for (int i = 1; i < GRUPPO_MAX; i++)
+        if (shm->GROUPWEIGHTS[i] > 0)
+            return 1;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+   Creazione (mensa, dopo la configurazione): tabella dei gruppi
+   e mappa dei posti, in un segmento dimensionato su NOFUSERS e
+   NOFTABLESEATS
+   --------------------------------------------------------- */
+void groups_create(shm_t *shm) {
+    int utenti = shm->NOFUSERS;
+    size_t size = groups_segment_size(utenti, shm->NOFTABLESEATS);
+
+    shm->groups_shmid = ipc_segment_create(size, "gruppi");
+    groups_seg = ipc_segment_attach(shm->groups_shmid, "gruppi");
+    groups_owner = 1;
+
+    memset(groups_seg, 0, size);
+    groups_seg->num_utenti = utenti;
+    groups_seg->num_posti  = shm->NOFTABLESEATS;
+    posti = (unsigned char *)&groups_seg->gruppo[utenti];
+
+    if (sem_init(&groups_seg->mutex_posti, 1, 1) < 0) {
+        perror("[GRUPPI] sem_init mutex_posti");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned int seed = shm->SEED ? shm->SEED : (unsigned int)time(NULL);
+    int attivi = groups_enabled(shm);
+    int id = 0;
+
+    while (id < utenti) {
+        int n = attivi ? draw_size(shm, &seed) : 1;
+        if (n > utenti - id)
+            n = utenti - id;
+        if (shm->NOFTABLESEATS > 0 && n > shm->NOFTABLESEATS)
+            n = shm->NOFTABLESEATS;     // il gruppo deve poter sedere insieme
+
+        groups_seg->gruppo[id].dimensione = n;
+        for (int k = 0; k < n; k++)
+            groups_seg->gruppo[id + k].capogruppo = id;
+        groups_seg->num_gruppi++;
+        id += n;
+    }
+
+    if (attivi)
+        printf("[GRUPPI] %d utenti in %d gruppi (media %.2f)\n", utenti,
+               groups_seg->num_gruppi, (double)utenti / groups_seg->num_gruppi);
+}
+
+void groups_attach(shm_t *shm) {
+    if (groups_seg == NULL)
+        map_segment(shm);
+}
+
+void groups_destroy(shm_t *shm) {
+    if (groups_seg != NULL) {
+        if (groups_owner)
+            sem_destroy(&groups_seg->mutex_posti);
+        shmdt(groups_seg);
+        groups_seg = NULL;
+        posti = NULL;
+    }
+    if (groups_owner)
+        shmctl(shm->groups_shmid, IPC_RMID, NULL);
+}
+
+gruppo_t *group_of(int user_id) {
+    return &groups_seg->gruppo[user_id];
+}
+
+/* ---------------------------------------------------------
+   Mappa dei posti. Il semaforo dei tavoli conta i posti liberi per
+   tutti: un singolo attende un'unita' sul semaforo e poi occupa un
+   posto qualsiasi, dal fondo della mappa, cosi' i blocchi liberi
+   restano in testa per i gruppi. Per ogni unita' presa e non ancora
+   segnata sulla mappa c'e' un posto libero, quindi il singolo lo
+   trova sempre.
+   --------------------------------------------------------- */
+int seats_take_single(void) {
+    int posto = -1;
+
+    lock_wait(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+    for (int i = groups_seg->num_posti - 1; i >= 0; i--) {
+        if (!posti[i]) {
+            posti[i] = 1;
+            posto = i;
+            break;
+        }
+    }
+    lock_post(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+    return posto;
+}
+
+/* Cerca n posti adiacenti liberi e li occupa, prendendo n unita' dal
+   semaforo dei tavoli. Ritorna l'indice del primo posto, -1 se non
+   c'e' un blocco libero o se i posti sono gia' promessi a singoli */
+int seats_try_block(int n, sem_t *tavoli) {
+    int primo = -1;
+
+    lock_wait(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+
+    int consecutivi = 0;
+    for (int i = 0; i < groups_seg->num_posti; i++) {
+        consecutivi = posti[i] ? 0 : consecutivi + 1;
+        if (consecutivi == n) {
+            primo = i - n + 1;
+            break;
+        }
+    }
+
+    if (primo >= 0) {
+        int prese = 0;
+        while (prese < n && sem_trywait(tavoli) == 0)
+            prese++;
+
+        if (prese == n) {
+            memset(&posti[primo], 1, n);
+        } else {
+            while (prese-- > 0)
+                sem_post(tavoli);
+            primo = -1;
+        }
+    }
+
+    lock_post(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+    return primo;
+}
+
+void seats_release_block(int primo, int n) {
+    lock_wait(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+    memset(&posti[primo], 0, n);
+    lock_post(&groups_seg->mutex_posti, &groups_seg->mutex_posti_stat);
+}
+
+/* Precedenza ai gruppi: finche' un gruppo attende da oltre
+   GRUPPO_PRECEDENZA_MINUTI i nuovi singoli non prendono posti */
+void seats_priority(int delta) {
+    __sync_fetch_and_add(&groups_seg->gruppi_in_precedenza, delta);
+}
+
+int seats_priority_pending(void) {
+    return __atomic_load_n(&groups_seg->gruppi_in_precedenza, __ATOMIC_ACQUIRE) > 0;
+}
+
+lockstat_t *seats_lockstat(void) {
+    return groups_seg != NULL ? &groups_seg->mutex_posti_stat : NULL;
+}
@@ -5,17 +5,167 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/msg.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include "shared_structs.h"
 #include "ipc.h"
+#include "simclock.h"
 
 static int shm_id = -1;
 shm_t *shm = NULL;
+volatile uint32_t *req_slots = NULL;
 
-shm_t *ipc_create_shared_memory(void) {
+/* ---------------------------------------------------------
+   Segmento principale (shm_t)
+   Backend scelto con l'ambiente, letto da mensa e ereditato dai figli
+   (la configurazione non e' ancora caricata quando il segmento nasce):
+   - MENSA_SHM        sysv (default, shmget) o posix (shm_open + mmap)
+   - MENSA_SHMNAME    nome del segmento posix, default /mensa.<pid>
+   - MENSA_HUGEPAGES  1 = pagine grandi: SHM_HUGETLB con sysv, file su
+                      MENSA_HUGETLBDIR (hugetlbfs) con posix; se non
+                      disponibili, THP con madvise(MADV_HUGEPAGE)
+   - MENSA_PREFAULT   1 = ogni processo mappa tutte le pagine all'attach,
+                      cosi' a giornata in corso non ci sono page fault
+   MAP_HUGETLB vale solo per mappature anonime, che non sopravvivono
+   all'exec di operatori e utenti: per un segmento con nome le pagine
+   grandi vengono da hugetlbfs o dalle THP del tmpfs.
+   --------------------------------------------------------- */
+#define SHM_PAGINA_GRANDE   (2UL << 20)     // allineamento per le THP
+
+static int shm_posix = 0;
+static int shm_creatore = 0;
+static char shm_nome[256];
+
+static int env_flag(const char *nome) {
+    const char *v = getenv(nome);
+    return v != NULL && atoi(v) != 0;
+}
+
+static size_t round_up(size_t n, size_t pagina) {
+    return (n + pagina - 1) / pagina * pagina;
+}
 
-    shm_id = shmget(IPC_PRIVATE, sizeof(shm_t), IPC_CREAT | 0666);
+/* Mappa subito tutte le pagine del segmento in questo processo */
+static void prefault(void *ptr, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    long pagina = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < size; off += pagina)
+        __atomic_fetch_add((char *)ptr + off, 0, __ATOMIC_RELAXED);
+}
+
+static void setup_mapping(void *ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+    if (env_flag("MENSA_HUGEPAGES"))
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    if (env_flag("MENSA_PREFAULT"))
+        prefault(ptr, size);
+}
+
+static int hugetlbfs_enabled(void) {
+    return env_flag("MENSA_HUGEPAGES") && getenv("MENSA_HUGETLBDIR") != NULL;
+}
+
+static void hugetlbfs_path(char *path, size_t n) {
+    snprintf(path, n, "%s%s", getenv("MENSA_HUGETLBDIR"), shm_nome);
+}
+
+/* Path del segmento posix: su hugetlbfs se richiesto, altrimenti shm_open */
+static int posix_open(int flags, size_t *pagina) {
+    *pagina = env_flag("MENSA_HUGEPAGES") ? SHM_PAGINA_GRANDE : (size_t)sysconf(_SC_PAGESIZE);
+
+    if (hugetlbfs_enabled()) {
+        char path[512];
+        struct statfs fs;
+        hugetlbfs_path(path, sizeof(path));
+        if (statfs(getenv("MENSA_HUGETLBDIR"), &fs) == 0)
+            *pagina = fs.f_bsize;
+        return open(path, flags, 0600);
+    }
+    return shm_open(shm_nome, flags, 0600);
+}
+
+static shm_t *posix_map(int fd, size_t size) {
+    shm_t *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        perror("[IPC] mmap");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+/* Crea e mappa il segmento posix; MAP_FAILED se non riesce */
+static shm_t *posix_create_map(size_t *size) {
+    size_t pagina;
+    int fd = posix_open(O_CREAT | O_EXCL | O_RDWR, &pagina);
+    if (fd < 0)
+        return MAP_FAILED;
+
+    shm_t *ptr = MAP_FAILED;
+    *size = round_up(sizeof(shm_t), pagina);
+    if (ftruncate(fd, *size) == 0)
+        ptr = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return ptr;
+}
+
+static shm_t *create_posix(void) {
+    const char *nome = getenv("MENSA_SHMNAME");
+    size_t size;
+
+    if (nome != NULL)
+        snprintf(shm_nome, sizeof(shm_nome), "%s%s", nome[0] == '/' ? "" : "/", nome);
+    else
+        snprintf(shm_nome, sizeof(shm_nome), "/mensa.%d", (int)getpid());
+
+    shm_t *ptr = posix_create_map(&size);
+
+    /* Senza pagine riservate hugetlbfs fallisce al mmap: come con
+       SHM_HUGETLB si ripiega sulle pagine normali, e i figli lo
+       ereditano perche' MENSA_HUGETLBDIR non e' piu' nell'ambiente */
+    if (ptr == MAP_FAILED && hugetlbfs_enabled()) {
+        char path[512];
+        hugetlbfs_path(path, sizeof(path));
+        printf("[IPC] hugetlbfs non disponibile (%s), uso pagine normali\n", strerror(errno));
+        unlink(path);
+        unsetenv("MENSA_HUGETLBDIR");
+        ptr = posix_create_map(&size);
+    }
+    if (ptr == MAP_FAILED) {
+        perror("[IPC] shm_open/mmap");
+        exit(EXIT_FAILURE);
+    }
+    shm_creatore = 1;
+
+    setenv("MENSA_SHMNAME", shm_nome, 1);
+    unsetenv("MENSA_SHMID");
+    printf("[IPC] Segmento posix %s, %zu byte\n", shm_nome, size);
+    return ptr;
+}
+
+static shm_t *create_sysv(void) {
+    size_t size = sizeof(shm_t);
+
+    shm_id = -1;
+#ifdef SHM_HUGETLB
+    if (env_flag("MENSA_HUGEPAGES")) {
+        size = round_up(sizeof(shm_t), SHM_PAGINA_GRANDE);
+        shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | SHM_HUGETLB | 0666);
+        if (shm_id < 0) {
+            printf("[IPC] SHM_HUGETLB non disponibile, uso pagine normali\n");
+            size = sizeof(shm_t);
+        }
+    }
+#endif
+    if (shm_id < 0)
+        shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0666);
     if (shm_id < 0) {
         perror("[IPC] shmget");
         exit(EXIT_FAILURE);
@@ -27,35 +177,109 @@ shm_t *ipc_create_shared_memory(void) {
         exit(EXIT_FAILURE);
     }
 
+    char buf[32];
+    sprintf(buf, "%d", shm_id);
+    setenv("MENSA_SHMID", buf, 1);
+    unsetenv("MENSA_SHMNAME");
+    return ptr;
+}
+
+shm_t *ipc_create_shared_memory(void) {
+    const char *backend = getenv("MENSA_SHM");
+    shm_posix = backend != NULL && strcmp(backend, "posix") == 0;
+
+    shm_t *ptr = shm_posix ? create_posix() : create_sysv();
+
     memset(ptr, 0, sizeof(shm_t));
+    setup_mapping(ptr, sizeof(shm_t));
 
     ptr->shm_id = shm_id;
     return ptr;
 }
 
 shm_t *ipc_attach_shared_memory(void) {
+    shm_t *ptr;
+    char *nome = getenv("MENSA_SHMNAME");
 
-    if (shm_id < 0) {
-        char *env = getenv("MENSA_SHMID");
-        if (!env) {
-            fprintf(stderr, "[IPC] Errore: MENSA_SHMID non impostato\n");
+    if (nome != NULL && shm_id < 0) {
+        size_t pagina;
+        snprintf(shm_nome, sizeof(shm_nome), "%s", nome);
+        int fd = posix_open(O_RDWR, &pagina);
+        if (fd < 0) {
+            perror("[IPC] shm_open attach");
+            exit(EXIT_FAILURE);
+        }
+        shm_posix = 1;
+        ptr = posix_map(fd, round_up(sizeof(shm_t), pagina));
+    } else {
+        if (shm_id < 0) {
+            char *env = getenv("MENSA_SHMID");
+            if (!env) {
+                fprintf(stderr, "[IPC] Errore: MENSA_SHMID non impostato\n");
+                exit(EXIT_FAILURE);
+            }
+            shm_id = atoi(env);
+        }
+
+        ptr = shmat(shm_id, NULL, 0);
+        if (ptr == (void *) -1) {
+            perror("[IPC] shmat attach");
             exit(EXIT_FAILURE);
         }
-        shm_id = atoi(env);
     }
 
-    shm_t *ptr = shmat(shm_id, NULL, 0);
-    if (ptr == (void *) -1) {
-        perror("[IPC] shmat attach");
+    setup_mapping(ptr, sizeof(shm_t));
+    return ptr;
+}
+
+/* ---------------------------------------------------------
+   Segmenti ausiliari (menu, slot delle richieste, anelli di log,
+   mappa dei posti): sempre SysV, con gli id in shm_t, ma con le
+   stesse pagine grandi e lo stesso prefault del segmento principale,
+   perche' sono i dati toccati a ogni richiesta
+   --------------------------------------------------------- */
+int ipc_segment_create(size_t size, const char *nome) {
+    int id = -1;
+#ifdef SHM_HUGETLB
+    if (env_flag("MENSA_HUGEPAGES")) {
+        id = shmget(IPC_PRIVATE, round_up(size, SHM_PAGINA_GRANDE),
+                    IPC_CREAT | SHM_HUGETLB | 0666);
+    }
+#endif
+    if (id < 0)
+        id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0666);
+    if (id < 0) {
+        fprintf(stderr, "[IPC] shmget %s: %s\n", nome, strerror(errno));
         exit(EXIT_FAILURE);
     }
+    return id;
+}
 
+void *ipc_segment_attach(int id, const char *nome) {
+    struct shmid_ds ds;
+    void *ptr = shmat(id, NULL, 0);
+    if (ptr == (void *) -1 || shmctl(id, IPC_STAT, &ds) < 0) {
+        fprintf(stderr, "[IPC] shmat %s: %s\n", nome, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    setup_mapping(ptr, ds.shm_segsz);
     return ptr;
 }
 
 void ipc_destroy_shared_memory(void) {
-    if (shm_id >= 0)
+    if (shm_posix) {
+        if (shm_creatore) {
+            if (hugetlbfs_enabled()) {
+                char path[512];
+                hugetlbfs_path(path, sizeof(path));
+                unlink(path);
+            } else {
+                shm_unlink(shm_nome);
+            }
+        }
+    } else if (shm_id >= 0) {
         shmctl(shm_id, IPC_RMID, NULL);
+    }
 }
 
 static void init_station_semaphore(station_t *st) {
@@ -67,21 +291,11 @@ static void init_station_semaphore(station_t *st) {
 
 void ipc_create_semaphores(void) {
 
-    if (sem_init(&shm->sem_barrier, 1, 0) < 0) {
-        perror("[IPC] sem_init barrier");
-        exit(EXIT_FAILURE);
-    }
-
     if (sem_init(&shm->sem_stats, 1, 1) < 0) {
         perror("[IPC] sem_init stats");
         exit(EXIT_FAILURE);
     }
 
-    if (sem_init(&shm->sem_day_start, 1, 0) < 0) {
-        perror("[IPC] sem_init day_start");
-        exit(EXIT_FAILURE);
-    }
-
     shm->simulation_running = 0;
 
     init_station_semaphore(&shm->st_primi);
@@ -98,10 +312,20 @@ void ipc_init_table_semaphore(void) {
     }
 }
 
+/* Ripristina i posti tra due giornate, a processi fermi sulla
+   barriera: la chiusura della giornata sveglia chi attende un posto
+   con post in piu' sul semaforo */
+void ipc_reset_table_semaphore(void) {
+    sem_destroy(&shm->sem_tavoli);
+    if (sem_init(&shm->sem_tavoli, 1, shm->NOFTABLESEATS) < 0) {
+        perror("[IPC] sem_init tavoli");
+        exit(EXIT_FAILURE);
+    }
+    shm->tavoli_liberi = shm->NOFTABLESEATS;
+}
+
 void ipc_destroy_semaphores(void) {
     sem_destroy(&shm->sem_tavoli);
-    sem_destroy(&shm->sem_barrier);
-    sem_destroy(&shm->sem_day_start);
     sem_destroy(&shm->sem_stats);
 
     sem_destroy(&shm->st_primi.mutex);
@@ -130,24 +354,61 @@ void ipc_destroy_message_queues(void) {
     msgctl(shm->msgid_cassa,   IPC_RMID, NULL);
 }
 
-void ipc_signal_ready(void) {
-    __sync_fetch_and_add(&shm->ready_count, 1);
+/* ---------------------------------------------------------
+   Stato delle richieste in coda: uno slot per utente e stazione,
+   in un segmento a parte dimensionato su NOFUSERS (mensa, dopo la
+   configurazione). Utente e operatore se lo contendono con una CAS:
+   chi vince decide se la richiesta viene servita o annullata.
+   --------------------------------------------------------- */
+void ipc_create_request_slots(void) {
+    size_t size = (size_t)shm->NOFUSERS * NUM_STATIONS * sizeof(uint32_t);
+
+    shm->slot_shmid = ipc_segment_create(size, "slot richieste");
+    ipc_attach_request_slots();
+    memset((void *)req_slots, 0, size);
+}
+
+void ipc_attach_request_slots(void) {
+    req_slots = ipc_segment_attach(shm->slot_shmid, "slot richieste");
 }
 
-void ipc_wait_barrier(void) {
+void ipc_destroy_request_slots(void) {
+    if (req_slots != NULL)
+        shmdt((void *)req_slots);
+    shmctl(shm->slot_shmid, IPC_RMID, NULL);
+}
 
-    int total = shm->NOFWORKERS + shm->NOFUSERS;
+/* ---------------------------------------------------------
+   mtype di una richiesta secondo la disciplina della stazione.
+   Con SJF e priorita' l'mtype e' una scadenza virtuale: secondi
+   simulati dall'apertura all'arrivo piu' QUEUEAGING per classe.
+   L'operatore riceve l'mtype piu' basso, quindi una richiesta
+   sfavorita passa davanti a quelle arrivate oltre classe*QUEUEAGING
+   secondi dopo di lei e non resta in coda indefinitamente. A parita'
+   di mtype la coda resta FIFO.
+   - SJF: classe = porzioni o piatti da pagare - 1, crescente con il
+     tempo di servizio atteso (serve_user)
+   - priorita': classe 0 per il personale (id < PRIORITYUSERS) e per
+     chi ha un solo piatto, 1 per gli altri
+   --------------------------------------------------------- */
+long ipc_request_mtype(int station_type, int user_id, int piatti, uint64_t t_arrivo_ns) {
+    int classe;
 
-    while (shm->ready_count < total) {
-        struct timespec t = {0, 1000000}; // 1ms
-        nanosleep(&t, NULL);
+    switch (shm->QUEUEDISCIPLINE[station_type]) {
+        case CODA_SJF:
+            classe = piatti > 1 ? piatti - 1 : 0;
+            break;
+        case CODA_PRIORITA:
+            classe = (user_id < shm->PRIORITYUSERS || piatti <= 1) ? 0 : 1;
+            break;
+        default:
+            return 1;
     }
-}
 
-void ipc_release_barrier(void) {
-    int total = shm->NOFWORKERS + shm->NOFUSERS;
-    
-    /* Sblocca tutti i processi */
-    for (int i = 0; i < total; i++)
-        sem_post(&shm->sem_barrier);
-}
\ No newline at end of file
+    long arrivo = 0;
+    if (t_arrivo_ns > shm->inizio_giorno_ns)
+        arrivo = (long)sim_ns_to_sec(t_arrivo_ns - shm->inizio_giorno_ns);
+
+    long mtype = 1 + arrivo + (long)classe * shm->QUEUEAGING;
+    return mtype < MTYPE_RICHIESTA_MAX ? mtype : MTYPE_RICHIESTA_MAX;
+}
@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include "shared_structs.h"
+#include "lockprof.h"
+#include "groups.h"
+
+#ifdef MENSA_LOCKPROF
+
+/* Istanti di acquisizione dei semafori posseduti da questo processo:
+   un processo possiede al piu' un'unita' di ogni semaforo per volta,
+   cosi' il tempo di possesso si misura anche per i semafori contatori */
+#define LOCKPROF_HELD_MAX 8
+
+static struct {
+    lockstat_t *ls;
+    long t_acquisito;
+} held[LOCKPROF_HELD_MAX];
+
+static inline long lock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void record_acquired(lockstat_t *ls, long t_inizio, int conteso) {
+    long t = lock_now();
+
+    __sync_fetch_and_add(&ls->acquisizioni, 1);
+    if (conteso) {
+        __sync_fetch_and_add(&ls->contese, 1);
+        __sync_fetch_and_add(&ls->attesa_ns, t - t_inizio);
+    }
+
+    for (int i = 0; i < LOCKPROF_HELD_MAX; i++) {
+        if (held[i].ls == NULL) {
+            held[i].ls = ls;
+            held[i].t_acquisito = t;
+            return;
+        }
+    }
+}
+
+int lock_wait(sem_t *s, lockstat_t *ls) {
+    if (sem_trywait(s) == 0) {
+        record_acquired(ls, 0, 0);
+        return 0;
+    }
+
+    long t_inizio = lock_now();
+    int rc;
+    while ((rc = sem_wait(s)) < 0 && errno == EINTR)
+        ;
+    if (rc == 0)
+        record_acquired(ls, t_inizio, 1);
+    return rc;
+}
+
+int lock_timedwait(sem_t *s, lockstat_t *ls, const struct timespec *abs) {
+    if (sem_trywait(s) == 0) {
+        record_acquired(ls, 0, 0);
+        return 0;
+    }
+
+    /* Le attese scadute non sono acquisizioni: contate a parte */
+    long t_inizio = lock_now();
+    int rc = sem_timedwait(s, abs);
+    int saved = errno;
+
+    if (rc == 0)
+        record_acquired(ls, t_inizio, 1);
+    else if (saved == ETIMEDOUT)
+        __sync_fetch_and_add(&ls->scadute, 1);
+
+    errno = saved;
+    return rc;
+}
+
+int lock_post(sem_t *s, lockstat_t *ls) {
+    for (int i = 0; i < LOCKPROF_HELD_MAX; i++) {
+        if (held[i].ls != ls)
+            continue;
+
+        long possesso = lock_now() - held[i].t_acquisito;
+        long max = ls->max_possesso_ns;
+        while (possesso > max &&
+               !__sync_bool_compare_and_swap(&ls->max_possesso_ns, max, possesso))
+            max = ls->max_possesso_ns;
+
+        held[i].ls = NULL;
+        break;
+    }
+
+    return sem_post(s);
+}
+
+static void print_row(const char *nome, lockstat_t *ls) {
+    double perc = ls->acquisizioni ? 100.0 * ls->contese / ls->acquisizioni : 0.0;
+    double media_us = ls->contese ? ls->attesa_ns / 1000.0 / ls->contese : 0.0;
+
+    printf("  %-18s %10ld %9ld %6.1f%% %9ld %12.2f %11.2f %13.2f\n", nome,
+           ls->acquisizioni, ls->contese, perc, ls->scadute,
+           ls->attesa_ns / 1e6, media_us, ls->max_possesso_ns / 1000.0);
+}
+
+#endif
+
+void lockprof_print(shm_t *shm) {
+#ifdef MENSA_LOCKPROF
+    printf("\nCONTESA DEI SEMAFORI:\n");
+    printf("  %-18s %10s %9s %7s %9s %12s %11s %13s\n", "semaforo", "acquisiz.",
+           "contese", "%", "scadute", "attesa ms", "media us", "max poss. us");
+    print_row("st_primi.mutex",   &shm->st_primi.mutex_stat);
+    print_row("st_secondi.mutex", &shm->st_secondi.mutex_stat);
+    print_row("st_coffee.mutex",  &shm->st_coffee.mutex_stat);
+    print_row("st_cassa.mutex",   &shm->st_cassa.mutex_stat);
+    print_row("sem_stats",        &shm->sem_stats_stat);
+    print_row("sem_tavoli",       &shm->sem_tavoli_stat);
+    if (groups_enabled(shm) && seats_lockstat() != NULL)
+        print_row("mutex_posti",      seats_lockstat());
+    printf("=========================================================\n\n");
+#else
+    (void)shm;
+#endif
+}
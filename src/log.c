@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "shared_structs.h"
+#include "ipc.h"
+#include "log.h"
+
+#define LOG_BATCH_SIZE      65536       // byte accumulati prima di una write()
+#define LOG_FLUSH_NS        2000000     // il writer svuota gli anelli ogni 2ms
+
+int log_level = LOG_LVL_INFO;
+
+static log_shm_t  *log_seg = NULL;
+static log_ring_t *my_ring = NULL;
+static int log_owner = 0;               // 1 nel processo che ha creato il segmento
+
+static pthread_t writer_thread;
+static volatile int writer_running = 0;
+static int log_fd = -1;
+
+static size_t log_segment_size(int nrings) {
+    return sizeof(log_shm_t) + (size_t)nrings * sizeof(log_ring_t);
+}
+
+/* ---------------------------------------------------------
+   Creazione del segmento di log (mensa, dopo la configurazione):
+   un anello per mensa, uno per ogni operatore e uno per ogni utente
+   --------------------------------------------------------- */
+void log_create(shm_t *shm) {
+    int nrings = 1 + shm->NOFWORKERS + shm->NOFUSERS;
+    size_t size = log_segment_size(nrings);
+
+    shm->log_shmid = ipc_segment_create(size, "log");
+    log_seg = ipc_segment_attach(shm->log_shmid, "log");
+
+    log_owner = 1;
+    memset(log_seg, 0, size);
+    log_seg->nrings = nrings;
+    log_seg->level  = shm->LOGLEVEL;
+}
+
+void log_attach(shm_t *shm, int slot) {
+    if (log_seg == NULL) {
+        log_seg = ipc_segment_attach(shm->log_shmid, "log");
+    }
+
+    log_level = log_seg->level;
+    if (slot >= 0 && slot < log_seg->nrings)
+        my_ring = &log_seg->rings[slot];
+}
+
+/* ---------------------------------------------------------
+   Scrittura non bloccante: formatta direttamente nel record
+   libero dell'anello; ad anello pieno il messaggio viene perso
+   e conteggiato, il processo non aspetta mai il writer
+   --------------------------------------------------------- */
+void log_write(int level, const char *fmt, ...) {
+    va_list ap;
+
+    if (my_ring == NULL) {
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    unsigned int head = my_ring->head;
+    unsigned int tail = __atomic_load_n(&my_ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= LOG_RING_SLOTS) {
+        my_ring->dropped++;
+        return;
+    }
+
+    log_rec_t *rec = &my_ring->rec[head % LOG_RING_SLOTS];
+
+    va_start(ap, fmt);
+    int n = vsnprintf(rec->text, sizeof(rec->text), fmt, ap);
+    va_end(ap);
+
+    if (n < 0)
+        return;
+    if (n > LOG_MSG_LEN) {
+        n = LOG_MSG_LEN;
+        rec->text[n - 1] = '\n';    // messaggio troncato
+    }
+    rec->len   = (unsigned short)n;
+    rec->level = (unsigned char)level;
+
+    __atomic_store_n(&my_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void flush_batch(char *buf, size_t *used) {
+    size_t off = 0;
+
+    if (log_fd == STDOUT_FILENO)
+        fflush(stdout);     // mantiene l'ordine con le printf di mensa
+
+    while (off < *used) {
+        ssize_t w = write(log_fd, buf + off, *used - off);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        off += (size_t)w;
+    }
+    *used = 0;
+}
+
+/* Svuota tutti gli anelli nel buffer, scrivendo a blocchi */
+static void drain_rings(char *buf, size_t *used) {
+    for (int i = 0; i < log_seg->nrings; i++) {
+        log_ring_t *r = &log_seg->rings[i];
+        unsigned int tail = r->tail;
+        unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+        while (tail != head) {
+            log_rec_t *rec = &r->rec[tail % LOG_RING_SLOTS];
+
+            if (*used + rec->len > LOG_BATCH_SIZE)
+                flush_batch(buf, used);
+            memcpy(buf + *used, rec->text, rec->len);
+            *used += rec->len;
+            tail++;
+        }
+
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (*used > 0)
+        flush_batch(buf, used);
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    static char buf[LOG_BATCH_SIZE];
+    size_t used = 0;
+
+    while (writer_running) {
+        drain_rings(buf, &used);
+        nanosleep(&(struct timespec){0, LOG_FLUSH_NS}, NULL);
+    }
+
+    /* Ultimo passaggio: i processi figli sono gia' terminati */
+    drain_rings(buf, &used);
+    return NULL;
+}
+
+/* ---------------------------------------------------------
+   Avvio del writer in background (thread di mensa)
+   LOGFILE "-" scrive su stdout
+   --------------------------------------------------------- */
+void log_start_writer(shm_t *shm) {
+    if (strcmp(shm->LOGFILE, "-") == 0) {
+        log_fd = STDOUT_FILENO;
+    } else {
+        log_fd = open(shm->LOGFILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log_fd < 0) {
+            perror("[LOG] open");
+            exit(EXIT_FAILURE);
+        }
+        printf("[LOG] Log dei processi su %s (livello %d)\n", shm->LOGFILE, shm->LOGLEVEL);
+    }
+
+    writer_running = 1;
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        fprintf(stderr, "[LOG] Impossibile avviare il writer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void log_stop_writer(void) {
+    if (!writer_running)
+        return;
+
+    writer_running = 0;
+    pthread_join(writer_thread, NULL);
+
+    unsigned long persi = 0;
+    for (int i = 0; i < log_seg->nrings; i++)
+        persi += log_seg->rings[i].dropped;
+    if (persi > 0)
+        printf("[LOG] Messaggi persi per anelli pieni: %lu\n", persi);
+
+    if (log_fd != STDOUT_FILENO)
+        close(log_fd);
+    log_fd = -1;
+}
+
+void log_destroy(shm_t *shm) {
+    if (log_seg != NULL) {
+        shmdt(log_seg);
+        log_seg = NULL;
+        my_ring = NULL;
+    }
+    if (log_owner)
+        shmctl(shm->log_shmid, IPC_RMID, NULL);
+}
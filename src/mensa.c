@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <errno.h>
 #include <time.h>
 
 #include "ipc.h"
@@ -11,12 +14,33 @@
 #include "stations.h"
 #include "stats.h"
 #include "util.h"
+#include "log.h"
+#include "profile.h"
+#include "lockprof.h"
+#include "simclock.h"
+#include "groups.h"
+#include "menu.h"
+#include "barrier.h"
 #include <sys/msg.h>
 
 extern shm_t *shm;
 int *operator_pids = NULL;
 int *user_pids = NULL;
 
+/* Risorse consumate da ogni figlio, raccolte con wait4 alla terminazione */
+typedef struct {
+    int raccolto;
+    int segnale;        // segnale che ha terminato il processo, 0 se uscito
+    struct rusage ru;
+} child_usage_t;
+
+static child_usage_t *usage_operatori = NULL;
+static child_usage_t *usage_utenti = NULL;
+
+#define ATTESA_FIGLI_NS     5000000000L     // uscita spontanea dei figli alla chiusura
+
+static uint64_t t_chiusura = 0;             // inizio della chiusura, per il tempo di uscita
+
 void init_ipc(void);
 void destroy_ipc(void);
 void create_stations(void);
@@ -28,6 +52,8 @@ void start_new_day(int day);
 void end_day(int day);
 void terminate_simulation(int cause);
 void cleanup_and_exit(int code);
+int collect_children(long attesa_ns);
+void print_process_usage(void);
 
 int main(int argc, char *argv[]) {
     printf("[MENSA] Avvio del processo responsabile...\n");
@@ -51,8 +77,28 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    /* Inizializza semaforo tavoli dopo aver caricato la configurazione */
+    simclock_calibrate(shm);
+
+    /* Inizializza semaforo tavoli e barriere dopo aver caricato la configurazione */
     ipc_init_table_semaphore();
+    barrier_init(&shm->barriera_avvio,  shm->NOFWORKERS + shm->NOFUSERS);
+    barrier_init(&shm->barriera_giorno, shm->NOFWORKERS + shm->NOFUSERS);
+
+    /* Anelli di log per ogni processo e writer in background */
+    log_create(shm);
+    log_attach(shm, LOG_SLOT_MENSA);
+    log_start_writer(shm);
+
+    ipc_create_request_slots();
+    groups_create(shm);
+
+    if (shm->TRACE) {
+        if (mkdir(shm->TRACEDIR, 0755) < 0 && errno != EEXIST) {
+            perror("[MENSA] mkdir TRACEDIR");
+            exit(EXIT_FAILURE);
+        }
+        printf("[MENSA] Traccia eventi in %s/\n", shm->TRACEDIR);
+    }
 
     create_stations();
 
@@ -64,10 +110,11 @@ int main(int argc, char *argv[]) {
 
     shm->giorno_corrente = 1;
     stats_reset_day(&shm->stats_giorno);
+    menu_reset_day();
     stations_assign_workers(shm);
     stations_refill_day(shm);
 
-    ipc_release_barrier();
+    barrier_open(&shm->barriera_avvio);
 
     simulate_days();
 
@@ -76,10 +123,7 @@ int main(int argc, char *argv[]) {
 }
 
 void init_ipc(void) {
-    shm = ipc_create_shared_memory();
-    char buf[32];
-    sprintf(buf, "%d", shm->shm_id);
-    setenv("MENSA_SHMID", buf, 1);
+    shm = ipc_create_shared_memory();     // esporta MENSA_SHMID o MENSA_SHMNAME ai figli
     ipc_create_semaphores();
     ipc_create_message_queues();
 }
@@ -88,6 +132,10 @@ void destroy_ipc(void) {
     printf("[MENSA] Deallocazione IPC...\n");
     ipc_destroy_message_queues();
     ipc_destroy_semaphores();
+    ipc_destroy_request_slots();
+    groups_destroy(shm);
+    menu_destroy(shm);
+    log_destroy(shm);
     ipc_destroy_shared_memory();
 }
 
@@ -135,10 +183,33 @@ void spawn_users(void) {
     }
 }
 
+/* ---------------------------------------------------------
+   Attende che operatori e utenti siano tutti alla barriera. Un
+   processo in ritardo non passa mai inosservato: ogni
+   BARRIERA_AVVISO_S secondi si segnala quanti mancano e dopo
+   BARRIERA_MAX_S la simulazione termina con errore.
+   --------------------------------------------------------- */
+#define BARRIERA_AVVISO_S   5
+#define BARRIERA_MAX_S      60
+
+static void collect_barrier(barrier_t *b, const char *fase) {
+    for (int s = BARRIERA_AVVISO_S; ; s += BARRIERA_AVVISO_S) {
+        if (barrier_collect(b, BARRIERA_AVVISO_S * 1000000000L) == 0)
+            return;
+
+        fprintf(stderr, "[MENSA] ATTENZIONE: %s, %d processi su %d alla barriera dopo %d s\n",
+                fase, barrier_arrived(b), b->partecipanti, s);
+        if (s >= BARRIERA_MAX_S) {
+            fprintf(stderr, "[MENSA] Errore: processi bloccati (%s), termino\n", fase);
+            cleanup_and_exit(EXIT_FAILURE);
+        }
+    }
+}
+
 void wait_all_ready(void) {
     printf("[MENSA] Attesa inizializzazione di operatori e utenti...\n");
 
-    ipc_wait_barrier();
+    collect_barrier(&shm->barriera_avvio, "avvio");
 
     printf("[MENSA] Tutti i processi sono pronti. Avvio simulazione.\n");
 }
@@ -148,24 +219,14 @@ void simulate_days(void) {
     for (int day = 1; day <= shm->SIMDURATION; day++) {
         start_new_day(day);
 
-        /* Simulazione del giorno:
-           1 minuto = NNANOSECS nanosecondi
-           un giorno = 240 minuti -> 4h di lavoro
-           Refill periodico ogni 10 minuti
-        */
-        long total_minutes = 240;  // 4 ore = 240 minuti
-        long refill_interval = 10;
-        long minute_ns = shm->NNANOSECS * 60;
-        long refill_interval_ns = minute_ns * refill_interval;
-
-        for (long elapsed_minutes = 0; elapsed_minutes < total_minutes; elapsed_minutes += refill_interval) {
-            nanosleep(&(struct timespec){
-                .tv_sec = refill_interval_ns / 1000000000,
-                .tv_nsec = refill_interval_ns % 1000000000
-            }, NULL);
+        /* Simulazione del giorno: GIORNATA_MINUTI minuti simulati,
+           refill periodico ogni REFILL_MINUTI minuti */
+        for (long elapsed_minutes = 0; elapsed_minutes < GIORNATA_MINUTI;
+             elapsed_minutes += REFILL_MINUTI) {
+            sim_sleep_min(REFILL_MINUTI);
 
             if (shm->simulation_running) {
-                stations_refill_periodic(shm);
+                stations_refill_periodic(shm, elapsed_minutes / REFILL_MINUTI + 1);
             }
         }
 
@@ -199,54 +260,102 @@ void clear_message_queues(void) {
     }
 }
 
+/* Porta vuota e gettoni pieni all'apertura della giornata */
+static void open_entrance(void) {
+    ingresso_t *in = &shm->ingresso;
+
+    in->prossimo_biglietto = 0;
+    in->biglietto_servito  = 0;
+    in->in_mensa           = 0;
+    in->gettoni            = shm->GATEBURST;
+    in->ultima_ricarica_ns = shm->inizio_giorno_ns;
+
+    /* Default: tanti utenti quanti ne possono essere serviti o seduti */
+    in->limite = shm->GATEMAXINFLIGHT;
+    if (in->limite <= 0)
+        in->limite = shm->NOFTABLESEATS + shm->st_primi.postazioni_totali +
+                     shm->st_secondi.postazioni_totali +
+                     shm->st_coffee.postazioni_totali +
+                     shm->st_cassa.postazioni_totali;
+
+    if (shm->GATEMODE == INGRESSO_MAX_DENTRO)
+        printf("[MENSA] Ingresso limitato a %d utenti in mensa\n", in->limite);
+    else if (shm->GATEMODE == INGRESSO_GETTONI)
+        printf("[MENSA] Ingresso a %.2f utenti/minuto (raffica %d)\n",
+               shm->GATERATE, shm->GATEBURST);
+}
+
+/* ---------------------------------------------------------
+   Chiusura della giornata in un solo passo: sim_stop() sveglia le
+   attese sul tempo simulato (servizi, pasti, pause, polling) e i post
+   sul semaforo dei tavoli quelle sui posti. Il semaforo torna a
+   NOFTABLESEATS all'inizio della giornata successiva.
+   --------------------------------------------------------- */
+static void stop_day(void) {
+    sim_stop();
+    for (int i = 0; i < shm->NOFUSERS; i++)
+        sem_post(&shm->sem_tavoli);
+}
+
 void start_new_day(int day) {
     printf("\n[MENSA] --- Inizio giorno %d ---\n", day);
+    collect_barrier(&shm->barriera_giorno, "inizio giornata");
+    ipc_reset_table_semaphore();
     clear_message_queues();
+    shm->st_primi.utenti_in_coda   = 0;
+    shm->st_secondi.utenti_in_coda = 0;
+    shm->st_coffee.utenti_in_coda  = 0;
+    shm->st_cassa.utenti_in_coda   = 0;
 
     if (day > 1) {
         shm->giorno_corrente = day;
         stats_reset_day(&shm->stats_giorno);
+        menu_reset_day();
         stations_assign_workers(shm);
         stations_refill_day(shm);
     }
 
     shm->stats_giorno.operatori_attivi = shm->NOFWORKERS;
-    shm->day_barrier_count = 0;  
+
+    /* Capacita' della giornata, per la quota persa nelle pause */
+    station_t *stazioni[NUM_STATIONS] = { &shm->st_primi, &shm->st_secondi,
+                                          &shm->st_coffee, &shm->st_cassa };
+    for (int i = 0; i < NUM_STATIONS; i++)
+        shm->stats_giorno.capacita_ns[i] =
+            stazioni[i]->postazioni_totali * sim_min_to_ns(GIORNATA_MINUTI);
+    shm->inizio_giorno_ns = sim_now_ns();
+    open_entrance();
     shm->simulation_running = 1;
-    int total = shm->NOFWORKERS + shm->NOFUSERS;
-    for (int i = 0; i < total; i++) {
-        sem_post(&shm->sem_day_start);
-    }
+    barrier_open(&shm->barriera_giorno);
 }
 
 void end_day(int day) {
     printf("[MENSA] Fine giorno %d\n", day);
-    shm->simulation_running = 0;
-    
-    /* Attende con timeout per evitare deadlock */
-    int wait_cycles = 0;
-    while (shm->day_barrier_count < shm->NOFUSERS && wait_cycles < 100) {
-        nanosleep(&(struct timespec){0, 50000000}, NULL);
-        wait_cycles++;
-    }
-    
-    printf("[MENSA] Tutti gli utenti hanno completato il giorno\n");
-    nanosleep(&(struct timespec){0, 100000000}, NULL);
+    stop_day();
+
+    /* Da qui operatori e utenti sono fermi fino alla prossima apertura */
+    uint64_t t_fine = sim_now_ns();
+    collect_barrier(&shm->barriera_giorno, "fine giornata");
+    printf("[MENSA] Tutti i processi hanno completato il giorno (%.3f ms)\n",
+           (sim_now_ns() - t_fine) / 1e6);
+    stations_collect_day(shm);
     
     if (shm->stats_giorno.utenti_in_attesa > 0) {
         printf("[MENSA] ATTENZIONE: %d utenti non hanno completato il servizio\n", 
                shm->stats_giorno.utenti_in_attesa);
     }
     stations_compute_leftovers(shm);
+    stations_plan_refill(shm);
     
     stats_print_day(&shm->stats_giorno, day);
     stats_update_totals(&shm->stats_tot, &shm->stats_giorno);
+    menu_update_totals();
 }
 
 void terminate_simulation(int cause) {
 
     shm->terminazione_causa = cause;
-    shm->simulation_running = 0;
+    stop_day();
 
     printf("\n========================================================\n");
     printf("          TERMINAZIONE SIMULAZIONE\n");
@@ -266,29 +375,217 @@ void terminate_simulation(int cause) {
     printf("========================================================\n\n");
 
     stats_print_final(&shm->stats_tot, shm->giorno_corrente);
+    lockprof_print(shm);
 
-    /* Sblocca eventuali processi in attesa */
-    int total = shm->NOFWORKERS + shm->NOFUSERS;
-    for (int i = 0; i < total; i++) {
-        sem_post(&shm->sem_day_start);
-    }
-
-    sleep(1);
+    /* Apre la barriera con simulation_running a 0: i processi escono */
+    t_chiusura = sim_now_ns();
+    barrier_open(&shm->barriera_giorno);
 
     cleanup_and_exit(EXIT_SUCCESS);
 }
 
+/* ---------------------------------------------------------
+   Uscita di mensa. Dopo una chiusura regolare i figli escono da soli:
+   si raccolgono man mano che terminano e le IPC si rimuovono appena
+   esce l'ultimo. SIGTERM solo a chi non e' uscito entro
+   ATTESA_FIGLI_NS, o subito se si esce per errore.
+   --------------------------------------------------------- */
 void cleanup_and_exit(int code) {
-    printf("[MENSA] Terminazione processi figli...\n");
+    if (t_chiusura == 0)
+        t_chiusura = sim_now_ns();
 
-    for (int i = 0; i < shm->NOFWORKERS; i++)
-        kill(operator_pids[i], SIGTERM);
+    printf("[MENSA] Attesa uscita processi figli...\n");
+    int per_segnale = collect_children(code == EXIT_SUCCESS ? ATTESA_FIGLI_NS : 0);
+    uint64_t t_figli = sim_now_ns();
 
-    for (int i = 0; i < shm->NOFUSERS; i++)
-        kill(user_pids[i], SIGTERM);
+    log_stop_writer();
+    destroy_ipc();
+    uint64_t t_ipc = sim_now_ns();
 
-    while (wait(NULL) > 0);
+    prof_print(shm);
+    print_process_usage();
 
-    destroy_ipc();
+    printf("[MENSA] Chiusura: figli usciti in %.3f ms (%d per segnale), IPC rimosse in %.3f ms\n",
+           (t_figli - t_chiusura) / 1e6, per_segnale, (t_ipc - t_figli) / 1e6);
     exit(code);
-}
\ No newline at end of file
+}
+
+/* Pid dei figli ordinati, per trovare in O(log N) lo slot di chi esce */
+typedef struct {
+    pid_t pid;
+    child_usage_t *usage;
+} child_index_t;
+
+static child_index_t *indice_figli = NULL;
+
+static int cmp_child(const void *a, const void *b) {
+    pid_t pa = ((const child_index_t *)a)->pid, pb = ((const child_index_t *)b)->pid;
+    return (pa > pb) - (pa < pb);
+}
+
+static void build_child_index(void) {
+    int n = shm->NOFWORKERS + shm->NOFUSERS;
+    indice_figli = malloc(n * sizeof(child_index_t));
+    if (indice_figli == NULL) {
+        perror("[MENSA] malloc indice figli");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < shm->NOFWORKERS; i++)
+        indice_figli[i] = (child_index_t){ operator_pids[i], &usage_operatori[i] };
+    for (int i = 0; i < shm->NOFUSERS; i++)
+        indice_figli[shm->NOFWORKERS + i] = (child_index_t){ user_pids[i], &usage_utenti[i] };
+
+    qsort(indice_figli, n, sizeof(child_index_t), cmp_child);
+}
+
+/* Registra le risorse di un figlio raccolto; 0 se non e' un figlio noto */
+static int record_child(pid_t pid, int status, const struct rusage *ru) {
+    child_index_t chiave = { pid, NULL };
+    child_index_t *f = bsearch(&chiave, indice_figli, shm->NOFWORKERS + shm->NOFUSERS,
+                               sizeof(child_index_t), cmp_child);
+    if (f == NULL || f->pid <= 0)
+        return 0;
+
+    child_usage_t *u = f->usage;
+
+    u->raccolto = 1;
+    u->segnale = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    u->ru = *ru;
+    return 1;
+}
+
+static int signal_stragglers(child_usage_t *usage, int *pids, int n) {
+    int inviati = 0;
+    for (int i = 0; i < n; i++) {
+        if (!usage[i].raccolto && pids[i] > 0 && kill(pids[i], SIGTERM) == 0)
+            inviati++;
+    }
+    return inviati;
+}
+
+/* ---------------------------------------------------------
+   Raccoglie i figli con wait4 man mano che escono, dormendo su
+   SIGCHLD tra un'uscita e l'altra. Allo scadere di attesa_ns termina
+   con SIGTERM quelli ancora vivi. Ritorna quanti sono stati terminati
+   da un segnale.
+   --------------------------------------------------------- */
+int collect_children(long attesa_ns) {
+    usage_operatori = calloc(shm->NOFWORKERS, sizeof(child_usage_t));
+    usage_utenti    = calloc(shm->NOFUSERS, sizeof(child_usage_t));
+    build_child_index();
+
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld, NULL);
+
+    uint64_t scadenza = sim_now_ns() + attesa_ns;
+    int mancanti = shm->NOFWORKERS + shm->NOFUSERS;
+    int segnalati = 0, per_segnale = 0;
+    int status;
+    struct rusage ru;
+    pid_t pid;
+
+    while (mancanti > 0) {
+        pid = wait4(-1, &status, segnalati ? 0 : WNOHANG, &ru);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;                  // ECHILD: nessun altro figlio
+        }
+        if (pid > 0) {
+            if (record_child(pid, status, &ru)) {
+                mancanti--;
+                per_segnale += WIFSIGNALED(status);
+            }
+            continue;
+        }
+
+        uint64_t ora = sim_now_ns();
+        if (ora >= scadenza) {
+            int n = signal_stragglers(usage_operatori, operator_pids, shm->NOFWORKERS) +
+                    signal_stragglers(usage_utenti, user_pids, shm->NOFUSERS);
+            printf("[MENSA] %d processi non usciti entro %.0f ms, invio SIGTERM\n",
+                   n, attesa_ns / 1e6);
+            segnalati = 1;
+            continue;
+        }
+
+        long resto = (long)(scadenza - ora);
+        struct timespec t = { resto / 1000000000L, resto % 1000000000L };
+        sigtimedwait(&sigchld, NULL, &t);
+    }
+
+    sigprocmask(SIG_UNBLOCK, &sigchld, NULL);
+    free(indice_figli);
+    indice_figli = NULL;
+    return per_segnale;
+}
+
+static double cpu_ms(const struct rusage *ru) {
+    return (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000.0 +
+           (ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) / 1000.0;
+}
+
+static void print_usage_group(const char *nome, child_usage_t *usage, int n) {
+    double user_ms = 0, sys_ms = 0;
+    long vcsw = 0, ivcsw = 0, rss_max = 0, rss_tot = 0, minflt = 0;
+    int raccolti = 0, terminati = 0;
+    int top[3] = { -1, -1, -1 };    // processi con piu' CPU
+
+    for (int i = 0; i < n; i++) {
+        struct rusage *ru = &usage[i].ru;
+        if (!usage[i].raccolto)
+            continue;
+
+        raccolti++;
+        if (usage[i].segnale)
+            terminati++;
+        user_ms += ru->ru_utime.tv_sec * 1000.0 + ru->ru_utime.tv_usec / 1000.0;
+        sys_ms  += ru->ru_stime.tv_sec * 1000.0 + ru->ru_stime.tv_usec / 1000.0;
+        vcsw    += ru->ru_nvcsw;
+        ivcsw   += ru->ru_nivcsw;
+        minflt  += ru->ru_minflt;
+        rss_tot += ru->ru_maxrss;
+        if (ru->ru_maxrss > rss_max)
+            rss_max = ru->ru_maxrss;
+
+        for (int k = 0; k < 3; k++) {
+            if (top[k] < 0 || cpu_ms(ru) > cpu_ms(&usage[top[k]].ru)) {
+                for (int j = 2; j > k; j--)
+                    top[j] = top[j - 1];
+                top[k] = i;
+                break;
+            }
+        }
+    }
+
+    printf("\n%s (%d raccolti su %d, %d terminati da segnale):\n", nome, raccolti, n, terminati);
+    if (raccolti == 0)
+        return;
+
+    printf("  CPU utente:              %10.2f ms (media %.3f ms)\n", user_ms, user_ms / raccolti);
+    printf("  CPU sistema:             %10.2f ms (media %.3f ms)\n", sys_ms, sys_ms / raccolti);
+    printf("  Context switch volontari:   %8ld (media %.1f)\n", vcsw, (double)vcsw / raccolti);
+    printf("  Context switch involontari: %8ld (media %.1f)\n", ivcsw, (double)ivcsw / raccolti);
+    printf("  RSS massimo:             %10ld KB (media %.0f KB)\n", rss_max, (double)rss_tot / raccolti);
+    printf("  Page fault minori:          %8ld (media %.1f)\n", minflt, (double)minflt / raccolti);
+
+    printf("  Processi con piu' CPU:\n");
+    for (int k = 0; k < 3 && top[k] >= 0; k++) {
+        struct rusage *ru = &usage[top[k]].ru;
+        printf("    id %-6d CPU %8.2f ms, cs %ld/%ld, RSS %ld KB\n", top[k],
+               cpu_ms(ru), ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_maxrss);
+    }
+}
+
+void print_process_usage(void) {
+    printf("\n================== RISORSE DEI PROCESSI ==================\n");
+    print_usage_group("OPERATORI", usage_operatori, shm->NOFWORKERS);
+    print_usage_group("UTENTI", usage_utenti, shm->NOFUSERS);
+    printf("===========================================================\n\n");
+
+    free(usage_operatori);
+    free(usage_utenti);
+}
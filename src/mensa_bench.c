@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/* ---------------------------------------------------------
+   Benchmark end-to-end della simulazione
+   Esegue ./mensa su una matrice fissa (e seminata) di NOFUSERS x
+   NOFWORKERS e registra per ogni esecuzione tempo reale, utenti
+   serviti al secondo, tempo CPU e context switch di tutto l'albero
+   di processi. Il risultato e' un file JSON.
+
+   Uso: mensa_bench [-q] [-o risultati.json] [-l etichetta] [-s seed]
+   -q  matrice ridotta per una verifica rapida
+   --------------------------------------------------------- */
+
+#define BENCH_CONFIG    "bench_config.conf"
+#define BENCH_TIMEOUT_S 600
+
+static const int users_full[]   = { 10, 100, 1000, 10000 };
+static const int workers_full[] = { 4, 8, 16 };
+static const int users_quick[]   = { 10, 100 };
+static const int workers_quick[] = { 4, 8 };
+
+typedef struct {
+    int users;
+    int workers;
+    double wall_s;
+    int served;
+    int not_served;
+    int days;
+    int overload;
+    double cpu_user_s;
+    double cpu_sys_s;
+    long vol_ctxsw;
+    long invol_ctxsw;
+    long maxrss_kb;
+    int exit_status;
+    int timed_out;
+} bench_run_t;
+
+static unsigned int seed = 42;
+
+static int write_config(int users, int workers) {
+    FILE *f = fopen(BENCH_CONFIG, "w");
+    if (!f) {
+        perror("[BENCH] fopen config");
+        return -1;
+    }
+
+    /* Carico bilanciato: la durata e' fissa, scala solo la popolazione */
+    fprintf(f, "NOFWORKERS %d\n", workers);
+    fprintf(f, "NOFUSERS %d\n", users);
+    fprintf(f, "SIMDURATION 2\n");
+    fprintf(f, "NNANOSECS 10000\n");
+    fprintf(f, "OVERLOADTHRESHOLD %d\n", users + 1);
+    fprintf(f, "NOFWKSEATSPRIMI %d\n", workers);
+    fprintf(f, "NOFWKSEATSSECONDI %d\n", workers);
+    fprintf(f, "NOFWKSEATSCOFFEE %d\n", workers);
+    fprintf(f, "NOFWKSEATSCASSA %d\n", workers);
+    fprintf(f, "NOFTABLESEATS %d\n", users);
+    fprintf(f, "AVGREFILLPRIMI %d\n", users);
+    fprintf(f, "AVGREFILLSECONDI %d\n", users);
+    fprintf(f, "MAXPORZIONIPRIMI %d\n", users);
+    fprintf(f, "MAXPORZIONISECONDI %d\n", users);
+    fprintf(f, "AVGSRVCPRIMI 100\n");
+    fprintf(f, "AVGSRVCMAINCOURSE 100\n");
+    fprintf(f, "AVGSRVCCOFFEE 100\n");
+    fprintf(f, "AVGSRVCCASSA 100\n");
+    fprintf(f, "NOFPAUSE 2\n");
+    fprintf(f, "PRICEPRIMI 4.50\n");
+    fprintf(f, "PRICESECONDI 6.00\n");
+    fprintf(f, "PRICECOFFEE 1.20\n");
+    fprintf(f, "SEED %u\n", seed);
+    fprintf(f, "LOGLEVEL 4\n");
+
+    fclose(f);
+    return 0;
+}
+
+static double tv_to_s(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Legge l'output di mensa ed estrae i totali dalle statistiche finali */
+static void parse_output(FILE *out, bench_run_t *r) {
+    char line[512];
+    int value;
+
+    while (fgets(line, sizeof(line), out)) {
+        if (sscanf(line, "Utenti serviti totali: %d", &value) == 1)
+            r->served = value;
+        else if (sscanf(line, "Utenti non serviti totali: %d", &value) == 1)
+            r->not_served = value;
+        else if (sscanf(line, "Giorni simulati: %d", &value) == 1)
+            r->days = value;
+        else if (sscanf(line, "Giorno di interruzione: %d", &value) == 1)
+            r->days = value;
+        else if (strncmp(line, "CAUSA: OVERLOAD", 15) == 0)
+            r->overload = 1;
+    }
+}
+
+static volatile sig_atomic_t timed_out = 0;
+
+static void on_alarm(int sig) {
+    (void)sig;
+    timed_out = 1;
+}
+
+static int run_one(bench_run_t *r) {
+    if (write_config(r->users, r->workers) < 0)
+        return -1;
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("[BENCH] pipe");
+        return -1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[BENCH] fork");
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);  // per poter terminare l'intero albero in caso di timeout
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl("./mensa", "mensa", BENCH_CONFIG, (char *)NULL);
+        perror("[BENCH] exec mensa");
+        _exit(EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    FILE *out = fdopen(fds[0], "r");
+
+    timed_out = 0;
+    alarm(BENCH_TIMEOUT_S);
+    parse_output(out, r);
+    fclose(out);
+    if (timed_out)
+        kill(-pid, SIGKILL);
+
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR)
+            break;
+        if (timed_out)
+            kill(-pid, SIGKILL);
+    }
+    alarm(0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    /* L'rusage restituito da wait4 include i figli gia' raccolti da mensa */
+    r->wall_s      = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    r->cpu_user_s  = tv_to_s(ru.ru_utime);
+    r->cpu_sys_s   = tv_to_s(ru.ru_stime);
+    r->vol_ctxsw   = ru.ru_nvcsw;
+    r->invol_ctxsw = ru.ru_nivcsw;
+    r->maxrss_kb   = ru.ru_maxrss;
+    r->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    r->timed_out   = timed_out;
+
+    return 0;
+}
+
+static void write_json(FILE *f, const char *label, bench_run_t *runs, int n) {
+    fprintf(f, "{\n");
+    fprintf(f, "  \"label\": \"%s\",\n", label);
+    fprintf(f, "  \"seed\": %u,\n", seed);
+    fprintf(f, "  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(f, "  \"runs\": [\n");
+
+    for (int i = 0; i < n; i++) {
+        bench_run_t *r = &runs[i];
+        fprintf(f, "    {\"users\": %d, \"workers\": %d, \"wall_s\": %.6f, "
+                   "\"served\": %d, \"not_served\": %d, \"days\": %d, \"overload\": %s, "
+                   "\"served_per_s\": %.3f, \"cpu_user_s\": %.6f, \"cpu_sys_s\": %.6f, "
+                   "\"vol_ctxsw\": %ld, \"invol_ctxsw\": %ld, \"maxrss_kb\": %ld, "
+                   "\"exit_status\": %d, \"timed_out\": %s}%s\n",
+                r->users, r->workers, r->wall_s,
+                r->served, r->not_served, r->days, r->overload ? "true" : "false",
+                r->wall_s > 0 ? r->served / r->wall_s : 0.0,
+                r->cpu_user_s, r->cpu_sys_s,
+                r->vol_ctxsw, r->invol_ctxsw, r->maxrss_kb,
+                r->exit_status, r->timed_out ? "true" : "false",
+                i + 1 < n ? "," : "");
+    }
+
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = "bench_results.json";
+    const char *label = "";
+    int quick = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "qo:l:s:")) != -1) {
+        switch (opt) {
+            case 'q': quick = 1; break;
+            case 'o': out_path = optarg; break;
+            case 'l': label = optarg; break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Uso: mensa_bench [-q] [-o risultati.json] [-l etichetta] [-s seed]\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (seed == 0)
+        seed = 42;  // 0 in configurazione significa "casuale"
+
+    const int *users   = quick ? users_quick : users_full;
+    const int *workers = quick ? workers_quick : workers_full;
+    int n_users   = quick ? 2 : (int)(sizeof(users_full) / sizeof(users_full[0]));
+    int n_workers = quick ? 2 : (int)(sizeof(workers_full) / sizeof(workers_full[0]));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_alarm;
+    sigaction(SIGALRM, &sa, NULL);  // senza SA_RESTART: interrompe wait4
+
+    int n = n_users * n_workers;
+    bench_run_t *runs = calloc(n, sizeof(bench_run_t));
+    int k = 0;
+
+    for (int u = 0; u < n_users; u++) {
+        for (int w = 0; w < n_workers; w++) {
+            bench_run_t *r = &runs[k++];
+            r->users = users[u];
+            r->workers = workers[w];
+
+            printf("[BENCH] NOFUSERS=%d NOFWORKERS=%d ... ", r->users, r->workers);
+            fflush(stdout);
+
+            if (run_one(r) < 0) {
+                printf("errore\n");
+                continue;
+            }
+
+            printf("%.2f s, %d serviti (%.1f/s), CPU %.2f s, ctxsw %ld/%ld%s\n",
+                   r->wall_s, r->served, r->wall_s > 0 ? r->served / r->wall_s : 0.0,
+                   r->cpu_user_s + r->cpu_sys_s, r->vol_ctxsw, r->invol_ctxsw,
+                   r->timed_out ? " (TIMEOUT)" : "");
+        }
+    }
+
+    unlink(BENCH_CONFIG);
+
+    FILE *f = fopen(out_path, "w");
+    if (!f) {
+        perror("[BENCH] fopen risultati");
+        return EXIT_FAILURE;
+    }
+    write_json(f, label, runs, n);
+    fclose(f);
+
+    printf("[BENCH] Risultati scritti in %s\n", out_path);
+    free(runs);
+    return EXIT_SUCCESS;
+}
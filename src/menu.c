@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "shared_structs.h"
+#include "ipc.h"
+#include "menu.h"
+
+menu_shm_t *menu = NULL;
+int *menu_porzioni = NULL;
+piatto_stats_t *menu_giorno = NULL;
+piatto_stats_t *menu_totale = NULL;
+
+static int menu_owner = 0;
+
+static void map_tables(void) {
+    menu_porzioni = (int *)((char *)menu + menu->off_porzioni);
+    menu_giorno   = (piatto_stats_t *)((char *)menu + menu->off_giorno);
+    menu_totale   = (piatto_stats_t *)((char *)menu + menu->off_totale);
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+/* Offset di un nome gia' copiato nell'area dei nomi, 0 se assente */
+static uint32_t find_name(const char *base, size_t inizio, size_t fine, const char *nome) {
+    for (size_t off = inizio; off < fine; off += strlen(base + off) + 1) {
+        if (strcmp(base + off, nome) == 0)
+            return (uint32_t)off;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------
+   Creazione (mensa, dopo la lettura di menu.txt): calcola la
+   dimensione del segmento, copia i nomi una volta sola e costruisce
+   la tabella dei piatti, ordinata per portata
+   --------------------------------------------------------- */
+int menu_create(shm_t *shm, char **nomi[NUM_PORTATE], const int conteggio[NUM_PORTATE]) {
+    int totale = 0;
+    size_t lunghezza_nomi = 0;
+
+    for (int p = 0; p < NUM_PORTATE; p++) {
+        if (conteggio[p] > MENU_MAX_PIATTI) {
+            fprintf(stderr, "[MENU] Errore: piu' di %d piatti in una portata\n", MENU_MAX_PIATTI);
+            return -1;
+        }
+        totale += conteggio[p];
+        for (int i = 0; i < conteggio[p]; i++)
+            lunghezza_nomi += strlen(nomi[p][i]) + 1;
+    }
+
+    size_t off_porzioni = align8(sizeof(menu_shm_t) + (size_t)totale * sizeof(piatto_t));
+    size_t off_giorno   = align8(off_porzioni + (size_t)totale * sizeof(int));
+    size_t off_totale   = off_giorno + (size_t)totale * sizeof(piatto_stats_t);
+    size_t off_nomi     = off_totale + (size_t)totale * sizeof(piatto_stats_t);
+    size_t size         = off_nomi + lunghezza_nomi;
+
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "[MENU] Errore: menu troppo grande\n");
+        return -1;
+    }
+
+    shm->menu_shmid = ipc_segment_create(size, "menu");
+    menu = ipc_segment_attach(shm->menu_shmid, "menu");
+    menu_owner = 1;
+
+    memset(menu, 0, size);
+    menu->dimensione   = size;
+    menu->num_piatti   = totale;
+    menu->off_porzioni = off_porzioni;
+    menu->off_giorno   = off_giorno;
+    menu->off_totale   = off_totale;
+    map_tables();
+
+    char *base = (char *)menu;
+    size_t fine_nomi = off_nomi;
+    int n = 0, condivisi = 0;
+
+    for (int p = 0; p < NUM_PORTATE; p++) {
+        menu->conteggio[p] = conteggio[p];
+        menu->primo[p] = n;
+
+        for (int i = 0; i < conteggio[p]; i++, n++) {
+            uint32_t off = find_name(base, off_nomi, fine_nomi, nomi[p][i]);
+            if (off == 0) {
+                off = (uint32_t)fine_nomi;
+                strcpy(base + fine_nomi, nomi[p][i]);
+                fine_nomi += strlen(nomi[p][i]) + 1;
+            } else {
+                condivisi++;
+            }
+
+            menu->piatti[n].nome    = off;
+            menu->piatti[n].portata = p;
+            menu->piatti[n].indice  = i;
+        }
+    }
+
+    printf("[MENU] %d piatti (%d primi, %d secondi, %d coffee), %zu byte, %d nomi condivisi\n",
+           totale, conteggio[PORTATA_PRIMI], conteggio[PORTATA_SECONDI],
+           conteggio[PORTATA_COFFEE], size, condivisi);
+    return 0;
+}
+
+void menu_attach(shm_t *shm) {
+    if (menu != NULL)
+        return;
+
+    menu = ipc_segment_attach(shm->menu_shmid, "menu");
+    map_tables();
+}
+
+void menu_destroy(shm_t *shm) {
+    if (menu != NULL) {
+        shmdt(menu);
+        menu = NULL;
+    }
+    if (menu_owner)
+        shmctl(shm->menu_shmid, IPC_RMID, NULL);
+}
+
+void menu_reset_day(void) {
+    memset(menu_giorno, 0, (size_t)menu->num_piatti * sizeof(piatto_stats_t));
+}
+
+/* Somma i contatori della giornata ai totali */
+void menu_update_totals(void) {
+    for (int i = 0; i < menu->num_piatti; i++) {
+        piatto_stats_t *t = &menu_totale[i], *d = &menu_giorno[i];
+        t->richieste       += d->richieste;
+        t->serviti         += d->serviti;
+        t->rifiuti         += d->rifiuti;
+        t->rifiuti_prima   += d->rifiuti_prima;
+        t->stock           += d->stock;
+        t->riforniti       += d->riforniti;
+        t->avanzati        += d->avanzati;
+        t->giorni_esaurito += d->esaurito_min > 0;
+    }
+}
@@ -8,18 +8,32 @@
 #include <errno.h>
 #include <sys/msg.h>
 #include <stddef.h>
+#include <math.h>
 #include "shared_structs.h"
 #include "ipc.h"
 #include "util.h"
+#include "log.h"
+#include "trace.h"
+#include "profile.h"
+#include "lockprof.h"
+#include "simclock.h"
+#include "menu.h"
+#include "barrier.h"
 
 extern shm_t *shm;
 static int operator_id = -1;
 static int station_type = -1;   // 0=primi, 1=secondi, 2=coffee, 3=cassa
+static int home_station = -1;   // stazione preferita, assegnata da mensa
 
 static int pause_count = 0;
 
+/* Durata di una pausa in minuti simulati */
+#define PAUSA_MIN_MINUTI    5
+#define PAUSA_MAX_MINUTI    15
+
 void operator_init(int id, int st_type);
 void operator_loop(void);
+int  acquire_any_station_post(void);
 int  acquire_station_post(void);
 void release_station_post(void);
 int  handle_pause(void);
@@ -34,27 +48,35 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
     operator_id  = atoi(argv[1]);
-    station_type = atoi(argv[2]);
+    home_station = atoi(argv[2]);
+    station_type = home_station;
 
     shm = ipc_attach_shared_memory();
-    ipc_signal_ready();
-
-    sem_wait(&shm->sem_barrier);
+    ipc_attach_request_slots();
+    menu_attach(shm);
+    log_attach(shm, LOG_SLOT_OPERATORE(operator_id));
+    barrier_wait(&shm->barriera_avvio);
 
     operator_init(operator_id, station_type);
+    trace_open(shm, TRACE_PROC_OPERATORE, operator_id);
     operator_loop();
+    PROF_FLUSH(shm->prof_operatore, PROF_OP_STAGES);
+    trace_close();
 
     return 0;
 }
 
 void operator_init(int id, int st_type) {
-    printf("[OPERATORE %d] Avviato su stazione %d\n", id, st_type);
-    srand(time(NULL) ^ (getpid()<<16));
+    LOG_INFO("[OPERATORE %d] Avviato su stazione %d\n", id, st_type);
+    if (shm->SEED != 0)
+        srand(shm->SEED * 7919u + (unsigned)id);    // esecuzione riproducibile
+    else
+        srand(time(NULL) ^ (getpid()<<16));
 }
 
 void operator_loop(void) {
     while (1) {
-        sem_wait(&shm->sem_day_start);
+        barrier_wait(&shm->barriera_giorno);
 
         if (!shm->simulation_running) {
             break;
@@ -62,14 +84,15 @@ void operator_loop(void) {
 
         pause_count = 0;
 
-        printf("[OPERATORE %d] Competizione per postazione alla stazione %d\n", 
-               operator_id, station_type);
+        LOG_DEBUG("[OPERATORE %d] Competizione per postazione (stazione preferita %d)\n", 
+               operator_id, home_station);
         
-        if (!acquire_station_post()) {
+        if (!acquire_any_station_post()) {
             continue;
         }
         
-        printf("[OPERATORE %d] Postazione acquisita, inizio turno\n", operator_id);
+        LOG_INFO("[OPERATORE %d] Postazione acquisita alla stazione %d, inizio turno\n",
+               operator_id, station_type);
 
         while (shm->simulation_running) {
             serve_user();
@@ -79,44 +102,78 @@ void operator_loop(void) {
                     if (!acquire_station_post()) {
                         break;
                     }
-                    printf("[OPERATORE %d] Rientrato dalla pausa\n", operator_id);
+                    LOG_INFO("[OPERATORE %d] Rientrato dalla pausa\n", operator_id);
                 }
             }
         }
         
-        printf("[OPERATORE %d] Fine turno giornaliero\n", operator_id);
+        LOG_INFO("[OPERATORE %d] Fine turno giornaliero\n", operator_id);
         release_station_post();
+        PROF_FLUSH(shm->prof_operatore, PROF_OP_STAGES);
     }
 }
 
-int acquire_station_post(void) {
+static station_t *get_station(int type) {
+    switch (type) {
+        case 0: return &shm->st_primi;
+        case 1: return &shm->st_secondi;
+        case 2: return &shm->st_coffee;
+        case 3: return &shm->st_cassa;
+    }
+    return NULL;
+}
 
-    station_t *st = NULL;
+static int try_acquire_post(station_t *st) {
+    int ok = 0;
 
-    switch (station_type) {
-        case 0: st = &shm->st_primi; break;
-        case 1: st = &shm->st_secondi; break;
-        case 2: st = &shm->st_coffee; break;
-        case 3: st = &shm->st_cassa; break;
-        default: return 0;
+    lock_wait(&st->mutex, &st->mutex_stat);
+    if (st->postazioni_occupate < st->postazioni_totali) {
+        st->postazioni_occupate++;
+        ok = 1;
     }
+    lock_post(&st->mutex, &st->mutex_stat);
 
+    return ok;
+}
+
+/* ---------------------------------------------------------
+   Inizio turno: l'operatore prova prima la stazione preferita,
+   poi le altre, cosi' le postazioni decise dal responsabile
+   vengono coperte indipendentemente dall'id dell'operatore
+   --------------------------------------------------------- */
+int acquire_any_station_post(void) {
     while (1) {
         if (!shm->simulation_running) {
             return 0;
         }
 
-        sem_wait(&st->mutex);
+        for (int k = 0; k < NUM_STATIONS; k++) {
+            int type = (home_station + k) % NUM_STATIONS;
+            if (try_acquire_post(get_station(type))) {
+                station_type = type;
+                return 1;
+            }
+        }
 
-        if (st->postazioni_occupate < st->postazioni_totali) {
-            st->postazioni_occupate++;
-            sem_post(&st->mutex);
-            return 1;
+        sim_poll(1);
+    }
+}
+
+int acquire_station_post(void) {
+
+    station_t *st = get_station(station_type);
+    if (st == NULL)
+        return 0;
+
+    while (1) {
+        if (!shm->simulation_running) {
+            return 0;
         }
 
-        sem_post(&st->mutex);
+        if (try_acquire_post(st))
+            return 1;
 
-        nanosleep(&(struct timespec){0, 10000000}, NULL); 
+        sim_poll(1);
     }
 }
 
@@ -130,77 +187,113 @@ void release_station_post(void) {
         default: return;
     }
 
-    sem_wait(&st->mutex);
+    lock_wait(&st->mutex, &st->mutex_stat);
     st->postazioni_occupate--;
-    sem_post(&st->mutex);
+    lock_post(&st->mutex, &st->mutex_stat);
 }
 
 /* ---------------------------------------------------------
    Gestione pause
-   Criteri per andare in pausa:
-   - Massimo NOF_PAUSE pause al giorno
-   - Probabilità casuale basata sul carico (più utenti = meno pause)
-   - Almeno un operatore deve rimanere attivo sulla stazione
+   Le NOFPAUSE pause della giornata sono distribuite nel turno: la
+   k-esima non puo' iniziare prima della frazione k/(NOFPAUSE+1)
+   della giornata. Oltre quell'istante l'operatore va in pausa
+   appena il carico lo permette:
+   - alla stazione restano almeno PAUSEMINSTAFF operatori (e almeno uno);
+   - la coda non supera PAUSEMAXQUEUE utenti per operatore rimasto.
+   Il tempo passato in pausa e' capacita' di servizio persa.
    Ritorna 1 se è andato in pausa, 0 altrimenti
    --------------------------------------------------------- */
 int handle_pause(void) {
-    station_t *st = NULL;
-    switch (station_type) {
-        case 0: st = &shm->st_primi; break;
-        case 1: st = &shm->st_secondi; break;
-        case 2: st = &shm->st_coffee; break;
-        case 3: st = &shm->st_cassa; break;
-        default: return 0;
-    }
+    station_t *st = get_station(station_type);
+    if (st == NULL)
+        return 0;
 
-    /* Probabilità di pausa: 5% base, ridotta se ci sono utenti in attesa */
-    int pausa_probabilita = 20; // 1/20 = 5%
-    if (st->utenti_in_coda > 5) {
-        pausa_probabilita = 50; // 1/50 = 2% se c'è carico
-    }
-    
-    if (rand_range(1, pausa_probabilita) != 1)
+    uint64_t prossima = shm->inizio_giorno_ns +
+        sim_min_to_ns((double)GIORNATA_MINUTI * (pause_count + 1) / (shm->NOFPAUSE + 1));
+    if (sim_now_ns() < prossima)
         return 0;
 
-    /* Verifica che NON sia l'unico operatore sulla stazione */
-    sem_wait(&st->mutex);
-    
-    /* Deve esserci almeno un altro operatore attivo (postazioni_occupate > 1) */
-    if (st->postazioni_occupate <= 1) {
-        sem_post(&st->mutex);
-        /* Non può andare in pausa: è l'unico operatore */
+    int minimo = shm->PAUSEMINSTAFF > 1 ? shm->PAUSEMINSTAFF : 1;
+
+    lock_wait(&st->mutex, &st->mutex_stat);
+
+    int rimasti = st->postazioni_occupate - 1;
+    if (rimasti < minimo || st->utenti_in_coda > shm->PAUSEMAXQUEUE * rimasti) {
+        lock_post(&st->mutex, &st->mutex_stat);
         return 0;
     }
     
     st->postazioni_occupate--;
     
-    sem_post(&st->mutex);
+    lock_post(&st->mutex, &st->mutex_stat);
 
     pause_count++;
-    shm->stats_giorno.pause_totali++;
+    __sync_fetch_and_add(&shm->stats_giorno.pause_totali, 1);
 
-    printf("[OPERATORE %d] Pausa %d/%d (postazioni ora: %d/%d)\n", 
+    LOG_INFO("[OPERATORE %d] Pausa %d/%d (postazioni ora: %d/%d, in coda %d)\n", 
            operator_id, pause_count, shm->NOFPAUSE,
-           st->postazioni_occupate, st->postazioni_totali);
+           st->postazioni_occupate, st->postazioni_totali, st->utenti_in_coda);
 
-    /* Durata pausa: tra 2 e 5 secondi */
-    long pausa_sec = rand_range(2, 5);
-    nanosleep(&(struct timespec){ .tv_sec = pausa_sec, .tv_nsec = 0 }, NULL);
+    uint64_t t_inizio = sim_now_ns();
+    sim_sleep_min(rand_range(PAUSA_MIN_MINUTI, PAUSA_MAX_MINUTI));
+    __sync_fetch_and_add(&shm->stats_giorno.pausa_ns[station_type], (long)(sim_now_ns() - t_inizio));
 
     return 1;
 }
 
+/* Minuto simulato della giornata in corso */
+static int minuto_giornata(void) {
+    uint64_t ora = sim_now_ns();
+    if (ora <= shm->inizio_giorno_ns)
+        return 0;
+    return (int)(sim_ns_to_sec(ora - shm->inizio_giorno_ns) / 60.0);
+}
+
+/* ---------------------------------------------------------
+   Contatori per piatto e per fascia (statistiche e piano dei
+   rifornimenti). Atomici, chiamati dopo aver rilasciato st->mutex:
+   la sezione critica resta limitata alle porzioni.
+   --------------------------------------------------------- */
+static void record_dish(int piatto, int quantita, int ripetuta, int serviti, int rimasti) {
+    piatto_stats_t *p = &menu_giorno[dish_slot(station_type, piatto)];
+    int minuto = minuto_giornata();
+    int fascia = minuto / REFILL_MINUTI;
+    if (fascia >= FASCE_REFILL)
+        fascia = FASCE_REFILL - 1;
+
+    /* La domanda per la previsione conta ogni utente una volta: i
+       tentativi su altri piatti della portata non sono nuova domanda */
+    if (!ripetuta)
+        __sync_fetch_and_add(&shm->stats_giorno.richieste_fascia[station_type][fascia], quantita);
+    __sync_fetch_and_add(&p->richieste, 1);
+    if (serviti > 0)
+        __sync_fetch_and_add(&p->serviti, serviti);
+    if (quantita > serviti) {
+        __sync_fetch_and_add(&p->rifiuti, quantita - serviti);
+        if (!ripetuta)
+            __sync_fetch_and_add(&p->rifiuti_prima, quantita - serviti);
+    }
+    if (rimasti == 0)
+        __sync_bool_compare_and_swap(&p->esaurito_min, 0, minuto + 1);
+}
+
 void serve_user(void) {
     int msgid = get_msg_queue();
     msg_request_t req;
     msg_response_t res;
+    PROF_DECL(t_fase);
 
     memset(&req, 0, sizeof(req));
-    ssize_t received = msgrcv(msgid, &req, MSG_REQ_SIZE, 1, IPC_NOWAIT | MSG_NOERROR);
+    PROF_START(t_fase);
+    ssize_t received = msgrcv(msgid, &req, MSG_REQ_SIZE, -MTYPE_RICHIESTA_MAX,
+                              IPC_NOWAIT | MSG_NOERROR);
+    PROF_END(PROF_OP_MSGRCV, t_fase);
     
     if (received < 0) {
         if (errno == ENOMSG) {
-            nanosleep(&(struct timespec){0, 10000000}, NULL); 
+            PROF_START(t_fase);
+            sim_poll(1);
+            PROF_END(PROF_OP_IDLE, t_fase);
             return;
         }
         if (!shm->simulation_running) {
@@ -210,28 +303,42 @@ void serve_user(void) {
         return;
     }
     
-    /*if (station_type == 3) {
-        printf("[CASSIERE %d] Ricevuto richiesta da utente %d (Primo:%d Secondo:%d Coffee:%d)\n",
-               operator_id, req.user_id, req.ha_primo, req.ha_secondo, req.ha_coffee);
-    }*/
-    
-    if (req.user_id < 0 || req.user_id >= shm->NOFUSERS || 
-        req.richiesta_tipo < 0 || req.richiesta_tipo > 3) {
-        printf("[OPERATORE %d] ERRORE: Messaggio corrotto! user_id=%d, tipo=%d\n", 
+    if (req.user_id >= (uint32_t)shm->NOFUSERS || req.richiesta_tipo > 3 ||
+        (station_type < 3 && req.piatto_scelto >= (unsigned)menu_count(station_type))) {
+        LOG_ERROR("[OPERATORE %d] ERRORE: Messaggio corrotto! user_id=%d, tipo=%d\n", 
                operator_id, req.user_id, req.richiesta_tipo);
         return;
     }
 
+    /* La richiesta passa a PRESA solo se l'utente e' ancora in coda:
+       se nel frattempo ha rinunciato viene scartata senza servirla */
+    if (!__sync_bool_compare_and_swap(&REQ_SLOT(req.user_id, station_type),
+                                      REQ_WORD(req.seq, REQ_IN_ATTESA),
+                                      REQ_WORD(req.seq, REQ_PRESA))) {
+        LOG_DEBUG("[OPERATORE %d] Richiesta annullata da utente %d, scartata\n",
+                  operator_id, req.user_id);
+        return;
+    }
+    __sync_fetch_and_sub(&get_station(station_type)->utenti_in_coda, 1);
+
+    /* Un gruppo chiede piu' porzioni con una sola richiesta */
+    int quantita = req.quantita > 0 ? req.quantita : 1;
+    int porzioni = 1;
+
     station_t *st = NULL;
     if (station_type == 0) st = &shm->st_primi;
     if (station_type == 1) st = &shm->st_secondi;
 
     if (st != NULL) {
-        sem_wait(&st->mutex);
-        if (st->porzioni[req.piatto_scelto] <= 0) {
-            sem_post(&st->mutex);
+        int *disponibili = dish_portions(station_type, req.piatto_scelto);
+        PROF_START(t_fase);
+        lock_wait(&st->mutex, &st->mutex_stat);
+        PROF_END(PROF_OP_MUTEX, t_fase);
+        if (*disponibili <= 0) {
+            lock_post(&st->mutex, &st->mutex_stat);
+            record_dish(req.piatto_scelto, quantita, req.ripetuta, 0, 0);
             memset(&res, 0, sizeof(res));
-            res.mtype = req.user_id+ 10000;   // così l'utente filtra per user_id
+            res.mtype = MTYPE_RISPOSTA(req.user_id);   // così l'utente filtra per user_id
             res.user_id = req.user_id;
             res.esito = 1; // piatto terminato
             size_t res_size = MSG_RES_SIZE;
@@ -240,36 +347,54 @@ void serve_user(void) {
         msgid, (size_t)MSG_RES_SIZE, res.mtype, errno);
                 perror("[OPERATORE] msgsnd");
             }
+            trace_event(TR_SERVICE_END, req.user_id, station_type, 1, req.piatto_scelto);
             return;
         }
-        st->porzioni[req.piatto_scelto]--;
-        sem_post(&st->mutex);
+        /* Si servono le porzioni rimaste, anche se meno di quelle chieste */
+        porzioni = quantita;
+        if (porzioni > *disponibili)
+            porzioni = *disponibili;
+        *disponibili -= porzioni;
+        int rimasti = *disponibili;
+        lock_post(&st->mutex, &st->mutex_stat);
+        record_dish(req.piatto_scelto, quantita, req.ripetuta, porzioni, rimasti);
+    } else if (station_type == 2) {
+        porzioni = quantita;
     }
-    struct timespec t_inizio_servizio;
-    clock_gettime(CLOCK_REALTIME, &t_inizio_servizio);
-
-    long t_ns = get_service_time_ns();
-    nanosleep(&(struct timespec){ .tv_sec = t_ns / 1000000000,
-                                  .tv_nsec = t_ns % 1000000000 }, NULL);
+    uint64_t t_inizio_servizio = sim_now_ns();
+    trace_event(TR_SERVICE_START, req.user_id, station_type, 0, req.piatto_scelto);
+
+    /* Un tempo di servizio per porzione; alla cassa il gruppo paga una
+       volta, con mezzo tempo in piu' per ogni articolo oltre il primo */
+    long t_ns = 0;
+    for (int i = 0; i < porzioni; i++)
+        t_ns += get_service_time_ns();
+    if (station_type == 3) {
+        int articoli = req.n_primi + req.n_secondi + req.n_coffee;
+        for (int i = 1; i < articoli; i++)
+            t_ns += get_service_time_ns() / 2;
+    }
+    PROF_START(t_fase);
+    sim_sleep_ns(t_ns);
+    PROF_END(PROF_OP_SERVIZIO, t_fase);
 
     memset(&res, 0, sizeof(res));
-    res.mtype         = req.user_id+ 10000;   
+    res.mtype         = MTYPE_RISPOSTA(req.user_id);
     res.user_id = req.user_id;
     res.esito = 0;
     res.piatto_servito = req.piatto_scelto;
-    res.t_servizio = t_inizio_servizio;
-
-    /*if (station_type == 3) {
-        printf("[CASSIERE %d] Invio risposta a utente %d: esito=%d, mtype=%ld\n",
-               operator_id, req.user_id, res.esito, res.mtype);
-    }*/
+    res.quantita = station_type == 3 ? quantita : porzioni;
+    res.t_servizio_ns = t_inizio_servizio;
 
     size_t res_size = MSG_RES_SIZE;
+    PROF_START(t_fase);
     if (msgsnd(msgid, &res, res_size, 0) < 0) {
                 fprintf(stderr, "[OPERATORE DEBUG] msgsnd fallita: msgid=%d, res_size=%zu, mtype=%ld, errno=%d\n",
         msgid, (size_t)MSG_RES_SIZE, res.mtype, errno);
         perror("[OPERATORE] msgsnd");
     }
+    PROF_END(PROF_OP_MSGSND, t_fase);
+    trace_event(TR_SERVICE_END, req.user_id, station_type, 0, req.piatto_scelto);
     update_stats_on_service(&req, &res);
 }
 
@@ -300,60 +425,59 @@ long get_service_time_ns(void) {
     long min = avg - (avg * perc / 100);
     long max = avg + (avg * perc / 100);
 
-    long ms = rand_range(min, max);
-    return ms * 1000000L;
+    /* AVGSRVC* in secondi simulati */
+    return sim_sec_to_ns(rand_range(min, max));
+}
+
+/* Classe dell'istogramma delle attese: 4*log2(1+s) in secondi simulati */
+static int attesa_classe(long wait_ns) {
+    double sec = wait_ns > 0 ? sim_ns_to_sec(wait_ns) : 0.0;
+    int c = (int)(ATTESA_SUDDIVISIONI * log2(1.0 + sec));
+    return c < ATTESA_CLASSI ? c : ATTESA_CLASSI - 1;
 }
 
 void update_stats_on_service(msg_request_t *req, msg_response_t *res) {
 
     stats_t *day = &shm->stats_giorno;
 
-    long wait_ns =
-        (res->t_servizio.tv_sec - req->t_arrivo.tv_sec) * 1000000000L +
-        (res->t_servizio.tv_nsec - req->t_arrivo.tv_nsec);
+    /* L'attesa conta una volta per ogni utente servito con la richiesta */
+    int quantita = res->quantita;
+    long wait_ns = (long)(res->t_servizio_ns - req->t_arrivo_ns) * quantita;
 
-    sem_wait(&shm->sem_stats);  // Mutua esclusione per aggiornamento statistiche
+    PROF_DECL(t_fase);
+    PROF_START(t_fase);
+    lock_wait(&shm->sem_stats, &shm->sem_stats_stat);  // Mutua esclusione per aggiornamento statistiche
+    PROF_END(PROF_OP_STATS, t_fase);
 
     switch (station_type) {
         case 0:
             day->tempo_attesa_primi_ns += wait_ns;
-            day->piatti_primi_serviti++;
+            day->piatti_primi_serviti += quantita;
             break;
 
         case 1:
             day->tempo_attesa_secondi_ns += wait_ns;
-            day->piatti_secondi_serviti++;
+            day->piatti_secondi_serviti += quantita;
             break;
 
         case 2:
             day->tempo_attesa_coffee_ns += wait_ns;
-            day->piatti_coffee_serviti++;
+            day->piatti_coffee_serviti += quantita;
             break;
 
         case 3:
             /* CASSA: calcola il totale in base ai piatti presi dall'utente */
             day->tempo_attesa_cassa_ns += wait_ns;
             
-            double totale = 0.0;
-            
-            if (req->ha_primo) {
-                totale += shm->PRICEPRIMI;
-            }
-            if (req->ha_secondo) {
-                totale += shm->PRICESECONDI;
-            }
-            if (req->ha_coffee) {
-                totale += shm->PRICECOFFEE;
-            }
+            double totale = req->n_primi   * shm->PRICEPRIMI +
+                            req->n_secondi * shm->PRICESECONDI +
+                            req->n_coffee  * shm->PRICECOFFEE;
             
             day->ricavo_giornaliero += totale;
-            
-            /*printf("[CASSIERE %d] Utente %d - Primo:%d Secondo:%d Coffee:%d - Totale: %.2f€\n",
-                   operator_id, req->user_id, req->ha_primo, req->ha_secondo, 
-                   req->ha_coffee, totale);
-            */
             break;
     }
 
-    sem_post(&shm->sem_stats);
+    day->attese_hist[station_type][attesa_classe(wait_ns / quantita)] += quantita;
+
+    lock_post(&shm->sem_stats, &shm->sem_stats_stat);
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string.h>
+#include "shared_structs.h"
+#include "profile.h"
+
+#ifdef MENSA_PROFILE
+
+prof_counter_t prof_local[PROF_MAX_STAGES];
+
+/* Somma i contatori locali del processo a quelli condivisi e li azzera */
+void prof_flush(prof_counter_t *table, int n) {
+    for (int i = 0; i < n; i++) {
+        if (prof_local[i].count == 0)
+            continue;
+        __sync_fetch_and_add(&table[i].total_ns, prof_local[i].total_ns);
+        __sync_fetch_and_add(&table[i].count, prof_local[i].count);
+    }
+    memset(prof_local, 0, sizeof(prof_local));
+}
+
+static void print_table(const char *title, prof_counter_t *table,
+                        const char **names, int n) {
+    long totale = 0;
+    for (int i = 0; i < n; i++)
+        totale += table[i].total_ns;
+
+    printf("\n%s:\n", title);
+    printf("  %-22s %12s %10s %12s %7s\n", "fase", "totale ms", "eventi", "media us", "%");
+    for (int i = 0; i < n; i++) {
+        double media_us = table[i].count ? table[i].total_ns / 1000.0 / table[i].count : 0.0;
+        double perc = totale ? 100.0 * table[i].total_ns / totale : 0.0;
+        printf("  %-22s %12.2f %10ld %12.2f %6.1f%%\n", names[i],
+               table[i].total_ns / 1e6, table[i].count, media_us, perc);
+    }
+}
+
+#endif
+
+void prof_print(shm_t *shm) {
+#ifdef MENSA_PROFILE
+    static const char *fasi_operatore[PROF_OP_STAGES] = {
+        "msgrcv", "coda vuota", "attesa st->mutex",
+        "servizio", "msgsnd", "attesa sem_stats"
+    };
+    static const char *fasi_utente[PROF_UT_STAGES] = {
+        "stazione primi", "stazione secondi", "stazione coffee",
+        "cassa", "attesa tavolo", "pasto", "attesa fine giornata",
+        "preordine stazioni"
+    };
+
+    printf("\n================== PROFILO DEI PROCESSI ==================\n");
+    print_table("OPERATORI (serve_user)", shm->prof_operatore, fasi_operatore, PROF_OP_STAGES);
+    print_table("UTENTI (user_loop)", shm->prof_utente, fasi_utente, PROF_UT_STAGES);
+    printf("===========================================================\n\n");
+#else
+    (void)shm;
+#endif
+}
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#include "shared_structs.h"
+#include "simclock.h"
+#include "barrier.h"
+
+long sim_sec_to_ns(double sim_sec) {
+    return (long)(sim_sec * shm->NNANOSECS);
+}
+
+long sim_min_to_ns(double sim_min) {
+    return sim_sec_to_ns(sim_min * SIM_SEC_PER_MIN);
+}
+
+double sim_ns_to_sec(long real_ns) {
+    if (shm->NNANOSECS <= 0)
+        return 0.0;
+    return (double)real_ns / shm->NNANOSECS;
+}
+
+/* Attesa reale, ripresa dopo eventuali interruzioni da segnale */
+static void sleep_ns(long real_ns) {
+    struct timespec t = { .tv_sec = real_ns / 1000000000L,
+                          .tv_nsec = real_ns % 1000000000L };
+    while (nanosleep(&t, &t) < 0 && errno == EINTR)
+        ;
+}
+
+/* ---------------------------------------------------------
+   Attese della giornata: dormono sulla parola futex di
+   simulation_running, quindi finiscono allo scadere o appena mensa
+   chiude la giornata con sim_stop(). A giornata chiusa ritornano
+   subito: servizi, pasti, pause e polling non ritardano la chiusura.
+   --------------------------------------------------------- */
+void sim_sleep_ns(long real_ns) {
+    uint32_t *running = (uint32_t *)&shm->simulation_running;
+    uint64_t fine = sim_now_ns() + (real_ns > 0 ? real_ns : 0);
+
+    while (__atomic_load_n(running, __ATOMIC_ACQUIRE) == 1) {
+        uint64_t ora = sim_now_ns();
+        if (ora >= fine)
+            return;
+
+        long resto = (long)(fine - ora);
+        struct timespec t = { resto / 1000000000L, resto % 1000000000L };
+        futex_wait(running, 1, &t);
+    }
+}
+
+void sim_stop(void) {
+    __atomic_store_n(&shm->simulation_running, 0, __ATOMIC_RELEASE);
+    futex_wake((uint32_t *)&shm->simulation_running, INT_MAX);
+}
+
+void sim_sleep_sec(double sim_sec) {
+    sim_sleep_ns(sim_sec_to_ns(sim_sec));
+}
+
+void sim_sleep_min(double sim_min) {
+    sim_sleep_ns(sim_min_to_ns(sim_min));
+}
+
+/* ---------------------------------------------------------
+   Attesa fra due controlli di una condizione (coda vuota, risposta
+   non ancora arrivata, ...): segue la scala simulata ma resta fra
+   SIM_POLL_MIN_NS e SIM_POLL_MAX_NS reali, per non saturare la CPU
+   con giornate compresse e non rallentare quelle in tempo reale
+   --------------------------------------------------------- */
+static long poll_ns(double sim_sec) {
+    long ns = sim_sec_to_ns(sim_sec);
+    if (ns < SIM_POLL_MIN_NS)
+        ns = SIM_POLL_MIN_NS;
+    if (ns > SIM_POLL_MAX_NS)
+        ns = SIM_POLL_MAX_NS;
+    return ns;
+}
+
+void sim_poll(double sim_sec) {
+    sim_sleep_ns(poll_ns(sim_sec));
+}
+
+/* Scadenza assoluta (CLOCK_REALTIME) per sem_timedwait */
+void sim_poll_deadline(struct timespec *ts, double sim_sec) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_nsec += poll_ns(sim_sec);
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+#if defined(__x86_64__)
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* TSC utilizzabile fra processi e core: frequenza costante e
+   conteggio anche negli stati di risparmio energetico */
+static int tsc_invariante(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 8) & 1;
+}
+#else
+static int tsc_invariante(void) {
+    return 0;
+}
+#endif
+
+/* ---------------------------------------------------------
+   Calibrazione della sorgente dei timestamp, chiamata da mensa
+   prima di creare i figli: il rapporto ns/tick viene misurato
+   contro CLOCK_MONOTONIC su TSC_CALIBRAZIONE_NS e salvato in
+   memoria condivisa
+   --------------------------------------------------------- */
+#define TSC_CALIBRAZIONE_NS 20000000L   // 20 ms
+
+void simclock_calibrate(shm_t *shm) {
+    shm->tsc_attivo = 0;
+
+    if (shm->TIMESOURCE != 1) {
+        printf("[CLOCK] Timestamp da CLOCK_MONOTONIC\n");
+        return;
+    }
+    if (!tsc_invariante()) {
+        printf("[CLOCK] TSC non invariante, uso CLOCK_MONOTONIC\n");
+        return;
+    }
+
+#if defined(__x86_64__)
+    uint64_t t0 = monotonic_ns();
+    uint64_t c0 = __builtin_ia32_rdtsc();
+    sleep_ns(TSC_CALIBRAZIONE_NS);
+    uint64_t t1 = monotonic_ns();
+    uint64_t c1 = __builtin_ia32_rdtsc();
+
+    if (c1 <= c0 || t1 <= t0) {
+        printf("[CLOCK] Calibrazione TSC fallita, uso CLOCK_MONOTONIC\n");
+        return;
+    }
+
+    shm->tsc_mult    = ((t1 - t0) << TSC_SHIFT) / (c1 - c0);
+    shm->tsc_base    = c1;
+    shm->tsc_base_ns = t1;
+    shm->tsc_attivo  = 1;
+
+    printf("[CLOCK] Timestamp da TSC calibrato (%.3f GHz)\n",
+           (double)(c1 - c0) / (t1 - t0));
+#endif
+}
@@ -2,38 +2,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include "shared_structs.h"
 #include "stations.h"
 #include "util.h"
+#include "simclock.h"
+#include "lockprof.h"
+#include "menu.h"
 
 void stations_init(shm_t *shm) {
     printf("[STATIONS] Inizializzazione stazioni...\n");
     shm->st_primi.postazioni_totali   = 0;
     shm->st_primi.postazioni_occupate = 0;
-    memset(shm->st_primi.porzioni, 0, sizeof(shm->st_primi.porzioni));
     shm->st_primi.tempo_attesa_totale_ns = 0;
     shm->st_primi.utenti_serviti = 0;
     shm->st_primi.utenti_in_coda = 0;
 
     shm->st_secondi.postazioni_totali   = 0;
     shm->st_secondi.postazioni_occupate = 0;
-    memset(shm->st_secondi.porzioni, 0, sizeof(shm->st_secondi.porzioni));
     shm->st_secondi.tempo_attesa_totale_ns = 0;
     shm->st_secondi.utenti_serviti = 0;
     shm->st_secondi.utenti_in_coda = 0;
 
     shm->st_coffee.postazioni_totali   = 0;
     shm->st_coffee.postazioni_occupate = 0;
-    for (int i = 0; i < MAX_COFFEE_TYPES; i++)
-        shm->st_coffee.porzioni[i] = -1; // infinito
     shm->st_coffee.tempo_attesa_totale_ns = 0;
     shm->st_coffee.utenti_serviti = 0;
     shm->st_coffee.utenti_in_coda = 0;
 
     shm->st_cassa.postazioni_totali   = 0;
     shm->st_cassa.postazioni_occupate = 0;
-    for (int i = 0; i < MAX_PRIMI_TYPES; i++)
-        shm->st_cassa.porzioni[i] = -1;
     shm->st_cassa.tempo_attesa_totale_ns = 0;
     shm->st_cassa.utenti_serviti = 0;
     shm->st_cassa.utenti_in_coda = 0;
@@ -41,43 +39,253 @@ void stations_init(shm_t *shm) {
     shm->tavoli_liberi = shm->NOFTABLESEATS;
 }
 
+/* Fine giornata, a processi fermi sulla barriera: riporta in
+   stats_giorno i contatori aggiornati dagli utenti sulle stazioni e li
+   azzera per la giornata successiva */
+void stations_collect_day(shm_t *shm) {
+    stats_t *day = &shm->stats_giorno;
+    station_t *st[NUM_STATIONS] = { &shm->st_primi, &shm->st_secondi,
+                                    &shm->st_coffee, &shm->st_cassa };
+
+    day->richieste_primi   = st[0]->richieste;
+    day->richieste_secondi = st[1]->richieste;
+    day->richieste_coffee  = st[2]->richieste;
+    day->richieste_cassa   = st[3]->richieste;
+
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        day->rinunce_arrivo[i]     = st[i]->rinunce_arrivo;
+        day->abbandoni_coda[i]     = st[i]->abbandoni_coda;
+        day->richieste_ripetute[i] = st[i]->richieste_ripetute;
+
+        st[i]->richieste          = 0;
+        st[i]->rinunce_arrivo     = 0;
+        st[i]->abbandoni_coda     = 0;
+        st[i]->richieste_ripetute = 0;
+    }
+}
+
+/* ---------------------------------------------------------
+   Piano dei rifornimenti (REFILLPLAN 1)
+   Per ogni piatto si stima la domanda giornaliera (porzioni servite
+   piu' quelle chieste a piatto esaurito) e, per stazione, la quota
+   della domanda in ogni fascia di REFILL_MINUTI, con una media
+   mobile esponenziale sui giorni precedenti. Al mattino e a ogni
+   rifornimento il piatto viene portato al livello che copre la
+   domanda delle fasce successive con probabilita'
+   PLANSOLDOUTCOST / (PLANSOLDOUTCOST + PLANLEFTOVERCOST) (domanda di
+   Poisson): alzare il livello di una porzione conviene finche' il
+   costo atteso dell'esaurimento supera quello dell'avanzo.
+   --------------------------------------------------------- */
+#define PIANO_PESO_NUOVO    0.5     // peso dell'ultimo giorno nella media mobile
+#define PIANO_FASCE_COPERTE 2       // fasce coperte dal livello di un rifornimento
+
+static double *domanda_prevista;    // per piatto, indicizzata come il menu
+static double quota_fascia[2][FASCE_REFILL];
+static int piano_pronto = 0;        // almeno un giorno osservato
+
+static station_t *dish_station(shm_t *shm, int s) {
+    return s == 0 ? &shm->st_primi : &shm->st_secondi;
+}
+
+static int dish_max(shm_t *shm, int s) {
+    return s == 0 ? shm->MAXPORZIONIPRIMI : shm->MAXPORZIONISECONDI;
+}
+
+/* Minimo q con P(domanda <= q) >= p, domanda di Poisson di media mu */
+static int poisson_quantile(double mu, double p) {
+    if (mu <= 0.0)
+        return 0;
+
+    double cdf = 0.0;
+    int limite = (int)(mu + 10.0 * sqrt(mu) + 10.0);
+    for (int k = 0; k < limite; k++) {
+        cdf += exp(k * log(mu) - mu - lgamma(k + 1.0));
+        if (cdf >= p)
+            return k;
+    }
+    return limite;
+}
+
+/* ---------------------------------------------------------
+   Livello obiettivo del piatto all'inizio della fascia indicata.
+   Copre la domanda delle prossime PIANO_FASCE_COPERTE fasce: chi
+   trova il piatto esaurito non aspetta il rifornimento successivo,
+   quindi una sola fascia lascerebbe senza margine le fluttuazioni
+   --------------------------------------------------------- */
+static int plan_level(shm_t *shm, int s, int piatto, int fascia) {
+    double p = (double)shm->PLANSOLDOUTCOST /
+               (shm->PLANSOLDOUTCOST + shm->PLANLEFTOVERCOST);
+    double quota = 0.0;
+    for (int f = fascia; f < fascia + PIANO_FASCE_COPERTE && f < FASCE_REFILL; f++)
+        quota += quota_fascia[s][f];
+
+    int livello = poisson_quantile(domanda_prevista[dish_slot(s, piatto)] * quota, p);
+    return livello < dish_max(shm, s) ? livello : dish_max(shm, s);
+}
+
+static int plan_active(shm_t *shm) {
+    return shm->REFILLPLAN && piano_pronto &&
+           shm->PLANSOLDOUTCOST + shm->PLANLEFTOVERCOST > 0;
+}
+
+/* Fine giornata: aggiorna la previsione con la domanda osservata */
+void stations_plan_refill(shm_t *shm) {
+    stats_t *day = &shm->stats_giorno;
+    double peso = piano_pronto ? PIANO_PESO_NUOVO : 1.0;
+
+    if (domanda_prevista == NULL) {
+        domanda_prevista = calloc(menu->num_piatti, sizeof(double));
+        if (!domanda_prevista) {
+            perror("[STATIONS] calloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < menu_count(s); i++) {
+            piatto_stats_t *p = &menu_giorno[dish_slot(s, i)];
+            double *prevista = &domanda_prevista[dish_slot(s, i)];
+            /* Domanda insoddisfatta contata una volta per utente: solo i
+               rifiuti alla prima scelta, non i tentativi sugli altri piatti */
+            *prevista = peso * (p->serviti + p->rifiuti_prima) + (1.0 - peso) * *prevista;
+        }
+
+        int totale = 0;
+        for (int f = 0; f < FASCE_REFILL; f++)
+            totale += day->richieste_fascia[s][f];
+        for (int f = 0; f < FASCE_REFILL; f++) {
+            double quota = totale ? (double)day->richieste_fascia[s][f] / totale
+                                  : 1.0 / FASCE_REFILL;
+            quota_fascia[s][f] = peso * quota + (1.0 - peso) * quota_fascia[s][f];
+        }
+    }
+    piano_pronto = 1;
+}
+
 void stations_refill_day(shm_t *shm) {
     printf("[STATIONS] Refill iniziale del giorno...\n");
-    for (int i = 0; i < shm->menu_primi_count; i++){
-        shm->st_primi.porzioni[i] = shm->AVGREFILLPRIMI;
-    }
+    int pianificato = plan_active(shm);
 
-    for (int i = 0; i < shm->menu_secondi_count; i++)
-        shm->st_secondi.porzioni[i] = shm->AVGREFILLSECONDI;
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < menu_count(s); i++) {
+            int *porzioni = dish_portions(s, i);
+            if (pianificato) {
+                *porzioni = plan_level(shm, s, i, 0);
+                printf("[STATIONS] %s: domanda prevista %.1f, al mattino %d\n",
+                       dish_name(s, i), domanda_prevista[dish_slot(s, i)], *porzioni);
+            } else {
+                *porzioni = s == 0 ? shm->AVGREFILLPRIMI : shm->AVGREFILLSECONDI;
+            }
+            menu_giorno[dish_slot(s, i)].stock = *porzioni;
+        }
+    }
 }
 
 /* ---------------------------------------------------------
-   Refill periodico (ogni 10 minuti simulati)
-   Chiamata da mensa.c durante il giorno
-   Incrementa di 1 porzione fino a MAX_PORZIONI per ogni tipo di piatto
+   Refill periodico (ogni REFILL_MINUTI minuti simulati)
+   Chiamata da mensa.c durante il giorno prima della fascia indicata.
+   Senza piano incrementa di 1 porzione fino a MAX_PORZIONI per ogni
+   tipo di piatto; con il piano porta ogni piatto al livello previsto
+   per la fascia.
    --------------------------------------------------------- */
-void stations_refill_periodic(shm_t *shm) {
-    for (int i = 0; i < shm->menu_primi_count; i++) {
-        if (shm->st_primi.porzioni[i] < shm->MAXPORZIONIPRIMI)
-            shm->st_primi.porzioni[i]++;
+void stations_refill_periodic(shm_t *shm, int fascia) {
+    int pianificato = plan_active(shm);
+    if (pianificato && fascia >= FASCE_REFILL)
+        return;     // giornata finita: niente porzioni che resterebbero avanzate
+
+    for (int s = 0; s < 2; s++) {
+        station_t *st = dish_station(shm, s);
+
+        lock_wait(&st->mutex, &st->mutex_stat);
+        for (int i = 0; i < menu_count(s); i++) {
+            int *porzioni = dish_portions(s, i);
+            int obiettivo = pianificato ? plan_level(shm, s, i, fascia)
+                                        : *porzioni + 1;
+            if (obiettivo > dish_max(shm, s))
+                obiettivo = dish_max(shm, s);
+            if (*porzioni < obiettivo) {
+                menu_giorno[dish_slot(s, i)].riforniti += obiettivo - *porzioni;
+                *porzioni = obiettivo;
+            }
+        }
+        lock_post(&st->mutex, &st->mutex_stat);
     }
+}
+
+/* ---------------------------------------------------------
+   Modello di coda M/M/c (Erlang C) per una stazione
+   lambda = arrivi per secondo simulato, srvc = tempo medio di
+   servizio (secondi simulati)
+   Ritorna il tempo medio di attesa in coda previsto (secondi simulati)
+   --------------------------------------------------------- */
+#define ATTESA_INSTABILE 1e12   // costo di una stazione con carico >= postazioni
 
-    for (int i = 0; i < shm->menu_secondi_count; i++) {
-        if (shm->st_secondi.porzioni[i] < shm->MAXPORZIONISECONDI)
-            shm->st_secondi.porzioni[i]++;
+static double erlang_c_wait(int c, double lambda, double srvc) {
+    if (lambda <= 0.0 || srvc <= 0.0)
+        return 0.0;
+
+    double a = lambda * srvc;   // carico offerto (Erlang)
+    if (c <= 0 || a >= c) {
+        /* Coda instabile: il costo decresce comunque con c, cosi' il
+           solutore continua ad aggiungere operatori dove servono */
+        return ATTESA_INSTABILE * (1.0 + a - c);
     }
+
+    /* Erlang B per ricorrenza, poi conversione in Erlang C */
+    double b = 1.0;
+    for (int k = 1; k <= c; k++)
+        b = a * b / (k + a * b);
+    double prob_attesa = c * b / (c - a * (1.0 - b));
+
+    return prob_attesa * srvc / (c - a);
+}
+
+/* ---------------------------------------------------------
+   Arrivo simultaneo (ARRIVI_INSIEME): le n richieste della giornata
+   trovano la stazione nello stesso istante e Erlang C, che suppone
+   arrivi distribuiti, non vale. Le c postazioni smaltiscono la coda
+   a turni e la k-esima richiesta attende floor(k/c) servizi.
+   Ritorna l'attesa media (secondi simulati)
+   --------------------------------------------------------- */
+static double burst_wait(int c, double n, double srvc) {
+    long richieste = (long)(n + 0.5);
+    if (c <= 0 || richieste <= 1 || srvc <= 0.0)
+        return 0.0;
+
+    long turni = richieste / c, resto = richieste % c;
+    double somma = c * (double)turni * (turni - 1) / 2.0 + (double)resto * turni;
+    return srvc * somma / richieste;
+}
+
+/* Attesa prevista con il modello adatto alla modalita' di arrivo */
+static double station_wait(shm_t *shm, int c, double lambda, double domanda, double srvc) {
+    if (shm->ARRIVALMODE == ARRIVI_INSIEME)
+        return burst_wait(c, domanda, srvc);
+    return erlang_c_wait(c, lambda, srvc);
 }
 
 /* ---------------------------------------------------------
    Assegnazione operatori alle stazioni
    Regole:
    - almeno 1 operatore per stazione
-   - operatori extra assegnati in base ai tempi medi (più lento → più operatori)
+   - al massimo NOFWKSEATS* postazioni per stazione
+   - operatori extra assegnati uno alla volta (greedy) alla stazione che
+     riduce di piu' l'attesa prevista dal modello Erlang C, usando la
+     domanda osservata nei giorni precedenti (stima a priori il giorno 1);
+     con ARRIVI_INSIEME l'attesa e' quella di una raffica (burst_wait)
+   - ALLOCOBJECTIVE: 0 = minimizza l'attesa massima, 1 = l'attesa totale
    --------------------------------------------------------- */
 void stations_assign_workers(shm_t *shm) {
     printf("[STATIONS] Assegnazione operatori alle stazioni...\n");
 
-    const int NUM_STATIONS = 4;
+    static const char *nomi[NUM_STATIONS] = { "PRIMI", "SECONDI", "COFFEE", "CASSA" };
+    station_t *st[NUM_STATIONS] = { &shm->st_primi, &shm->st_secondi,
+                                    &shm->st_coffee, &shm->st_cassa };
+    int cap[NUM_STATIONS] = { shm->NOFWKSEATSPRIMI, shm->NOFWKSEATSSECONDI,
+                              shm->NOFWKSEATSCOFFEE, shm->NOFWKSEATSCASSA };
+    double srvc[NUM_STATIONS] = { shm->AVGSRVCPRIMI, shm->AVGSRVCMAINCOURSE,
+                                  shm->AVGSRVCCOFFEE, shm->AVGSRVCCASSA };
+
     int operatori_disponibili = shm->NOFWORKERS;
 
     if (operatori_disponibili < NUM_STATIONS) {
@@ -86,92 +294,150 @@ void stations_assign_workers(shm_t *shm) {
         exit(EXIT_FAILURE);
     }
 
-    shm->st_primi.postazioni_totali = 1;
-    shm->st_secondi.postazioni_totali = 1;
-    shm->st_coffee.postazioni_totali = 1;
-    shm->st_cassa.postazioni_totali = 1;
-    operatori_disponibili -= NUM_STATIONS;
+    /* Domanda per giornata: media dei giorni gia' conclusi, altrimenti
+       stima a priori dal comportamento degli utenti (primo e secondo
+       voluti con prob. 2/3, coffee con prob. 1/2, tutti passano in cassa) */
+    double domanda[NUM_STATIONS];
+    int giorni_osservati = shm->giorno_corrente - 1;
+    stats_t *tot = &shm->stats_tot;
 
-    printf("[STATIONS] Tempi medi di servizio (ns):\n");
-    printf("  PRIMI:   %d ns\n", shm->AVGSRVCPRIMI);
-    printf("  SECONDI: %d ns\n", shm->AVGSRVCMAINCOURSE);
-    printf("  COFFEE:  %d ns\n", shm->AVGSRVCCOFFEE);
-    printf("  CASSA:   %d ns\n", shm->AVGSRVCCASSA);
+    if (giorni_osservati > 0 && tot->richieste_cassa > 0) {
+        domanda[0] = (double)tot->richieste_primi   / giorni_osservati;
+        domanda[1] = (double)tot->richieste_secondi / giorni_osservati;
+        domanda[2] = (double)tot->richieste_coffee  / giorni_osservati;
+        domanda[3] = (double)tot->richieste_cassa   / giorni_osservati;
+    } else {
+        domanda[0] = shm->NOFUSERS * 2.0 / 3.0;
+        domanda[1] = shm->NOFUSERS * 2.0 / 3.0;
+        domanda[2] = shm->NOFUSERS * 0.5;
+        domanda[3] = shm->NOFUSERS;
+    }
 
-    int tempo_totale = shm->AVGSRVCPRIMI + shm->AVGSRVCMAINCOURSE + 
-                       shm->AVGSRVCCOFFEE + shm->AVGSRVCCASSA;
+    /* Alla cassa ogni articolo oltre il primo aggiunge mezzo AVGSRVCCASSA
+       (serve_user): si usa la media degli articoli pagati */
+    double articoli = 2.0 / 3.0 + 2.0 / 3.0 + 0.5;
+    if (giorni_osservati > 0 && tot->richieste_cassa > 0)
+        articoli = (double)(tot->piatti_primi_serviti + tot->piatti_secondi_serviti +
+                            tot->piatti_coffee_serviti) / tot->richieste_cassa;
+    if (articoli > 1.0)
+        srvc[3] *= (1.0 + articoli) / 2.0;
 
-    if (tempo_totale <= 0) {
-        printf("[STATIONS] ATTENZIONE: tempi di servizio non validi, uso distribuzione uniforme\n");
-        tempo_totale = 1;
+    /* Frequenza degli arrivi: la domanda si distribuisce sulla finestra
+       di arrivo; con il picco di mezzogiorno si dimensiona sulla fascia
+       piu' carica */
+    double finestra_sec = (double)GIORNATA_MINUTI * SIM_SEC_PER_MIN;
+    double fattore_picco = 1.0;
+    if (shm->ARRIVALMODE != ARRIVI_INSIEME)
+        finestra_sec = (double)shm->ARRIVALWINDOW * SIM_SEC_PER_MIN;
+    if (shm->ARRIVALMODE == ARRIVI_PICCO) {
+        static const int curva[ARRIVI_SLOT] = CURVA_ARRIVI;
+        int somma = 0, massimo = 0;
+        for (int i = 0; i < ARRIVI_SLOT; i++) {
+            somma += curva[i];
+            if (curva[i] > massimo)
+                massimo = curva[i];
+        }
+        fattore_picco = (double)massimo * ARRIVI_SLOT / somma;
     }
 
-    /* Distribuisce gli operatori rimanenti in modo proporzionale ai tempi medi */
-    if (operatori_disponibili > 0) {
-        double ratio_primi = (double)shm->AVGSRVCPRIMI / tempo_totale;
-        double ratio_secondi = (double)shm->AVGSRVCMAINCOURSE / tempo_totale;
-        double ratio_coffee = (double)shm->AVGSRVCCOFFEE / tempo_totale;
-        double ratio_cassa = (double)shm->AVGSRVCCASSA / tempo_totale;
-
-        int extra_primi = (int)(ratio_primi * operatori_disponibili);
-        int extra_secondi = (int)(ratio_secondi * operatori_disponibili);
-        int extra_coffee = (int)(ratio_coffee * operatori_disponibili);
-        int extra_cassa = (int)(ratio_cassa * operatori_disponibili);
-
-        /* Assegna gli operatori extra */
-        shm->st_primi.postazioni_totali += extra_primi;
-        shm->st_secondi.postazioni_totali += extra_secondi;
-        shm->st_coffee.postazioni_totali += extra_coffee;
-        shm->st_cassa.postazioni_totali += extra_cassa;
-
-        /* Gestisce eventuali operatori rimanenti per arrotondamento */
-        int assegnati = extra_primi + extra_secondi + extra_coffee + extra_cassa;
-        int rimanenti = operatori_disponibili - assegnati;
-
-        /* Assegna i rimanenti alla stazione più lenta */
-        if (rimanenti > 0) {
-            int max_time = shm->AVGSRVCPRIMI;
-            station_t *max_station = &shm->st_primi;
-
-            if (shm->AVGSRVCMAINCOURSE > max_time) {
-                max_time = shm->AVGSRVCMAINCOURSE;
-                max_station = &shm->st_secondi;
-            }
-            if (shm->AVGSRVCCOFFEE > max_time) {
-                max_time = shm->AVGSRVCCOFFEE;
-                max_station = &shm->st_coffee;
-            }
-            if (shm->AVGSRVCCASSA > max_time) {
-                max_station = &shm->st_cassa;
+    double lambda[NUM_STATIONS];
+    int assegnati[NUM_STATIONS];
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        lambda[i] = domanda[i] / finestra_sec * fattore_picco;
+        assegnati[i] = 1;
+        if (cap[i] <= 0)
+            cap[i] = shm->NOFWORKERS;   // nessun limite configurato
+    }
+    operatori_disponibili -= NUM_STATIONS;
+
+    while (operatori_disponibili > 0) {
+        int scelta = -1;
+        double miglior_valore = 0.0;
+
+        for (int i = 0; i < NUM_STATIONS; i++) {
+            if (assegnati[i] >= cap[i])
+                continue;
+
+            double attesa = station_wait(shm, assegnati[i], lambda[i], domanda[i], srvc[i]);
+            double valore;
+            if (shm->ALLOCOBJECTIVE == 1) {
+                /* guadagno sull'attesa totale (pesata per gli arrivi) */
+                valore = lambda[i] * (attesa - station_wait(shm, assegnati[i] + 1, lambda[i],
+                                                            domanda[i], srvc[i]));
+            } else {
+                /* la stazione peggiore riceve il prossimo operatore */
+                valore = attesa;
             }
 
-            max_station->postazioni_totali += rimanenti;
+            if (scelta < 0 || valore > miglior_valore) {
+                scelta = i;
+                miglior_valore = valore;
+            }
         }
+
+        if (scelta < 0)
+            break;  // tutte le stazioni hanno raggiunto NOFWKSEATS*
+
+        assegnati[scelta]++;
+        operatori_disponibili--;
     }
 
-    int total_assigned = shm->st_primi.postazioni_totali + 
-                         shm->st_secondi.postazioni_totali +
-                         shm->st_coffee.postazioni_totali + 
-                         shm->st_cassa.postazioni_totali;
+    printf("[STATIONS] Domanda stimata (%s), obiettivo: %s, modello: %s\n",
+           giorni_osservati > 0 ? "giorni precedenti" : "a priori",
+           shm->ALLOCOBJECTIVE == 1 ? "attesa totale" : "attesa massima",
+           shm->ARRIVALMODE == ARRIVI_INSIEME ? "arrivo simultaneo" : "Erlang C");
+
+    double attesa_max = 0.0, attesa_tot = 0.0;
+    int total_assigned = 0;
 
     printf("[STATIONS] Postazioni assegnate (su %d operatori):\n", shm->NOFWORKERS);
-    printf("  PRIMI:   %d postazioni (%.1f%%)\n", shm->st_primi.postazioni_totali,
-           100.0 * shm->st_primi.postazioni_totali / shm->NOFWORKERS);
-    printf("  SECONDI: %d postazioni (%.1f%%)\n", shm->st_secondi.postazioni_totali,
-           100.0 * shm->st_secondi.postazioni_totali / shm->NOFWORKERS);
-    printf("  COFFEE:  %d postazioni (%.1f%%)\n", shm->st_coffee.postazioni_totali,
-           100.0 * shm->st_coffee.postazioni_totali / shm->NOFWORKERS);
-    printf("  CASSA:   %d postazioni (%.1f%%)\n", shm->st_cassa.postazioni_totali,
-           100.0 * shm->st_cassa.postazioni_totali / shm->NOFWORKERS);
-    printf("  TOTALE:  %d postazioni\n", total_assigned);
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        st[i]->postazioni_totali = assegnati[i];
+        total_assigned += assegnati[i];
+
+        double attesa = station_wait(shm, assegnati[i], lambda[i], domanda[i], srvc[i]);
+        if (attesa > attesa_max)
+            attesa_max = attesa;
+        attesa_tot += domanda[i] * attesa;
+
+        if (shm->ARRIVALMODE == ARRIVI_INSIEME) {
+            printf("  %-8s %d postazioni (max %d), domanda %.1f, attesa prevista %.2f s\n",
+                   nomi[i], assegnati[i], cap[i], domanda[i], attesa);
+        } else if (attesa >= ATTESA_INSTABILE) {
+            printf("  %-8s %d postazioni (max %d), domanda %.1f, attesa prevista: coda instabile\n",
+                   nomi[i], assegnati[i], cap[i], domanda[i]);
+        } else {
+            printf("  %-8s %d postazioni (max %d), domanda %.1f, utilizzo %.2f, attesa prevista %.2f s\n",
+                   nomi[i], assegnati[i], cap[i], domanda[i],
+                   lambda[i] * srvc[i] / assegnati[i], attesa);
+        }
+    }
+    printf("  TOTALE:  %d postazioni", total_assigned);
+    if (operatori_disponibili > 0)
+        printf(" (%d operatori senza postazione per i limiti NOFWKSEATS*)", operatori_disponibili);
+    printf("\n");
+
+    if (attesa_max >= ATTESA_INSTABILE) {
+        printf("  Costo previsto: almeno una stazione sovraccarica\n");
+    } else {
+        printf("  Costo previsto: attesa massima %.2f s, attesa totale %.2f s\n",
+               attesa_max, attesa_tot);
+    }
 }
 
 void stations_compute_leftovers(shm_t *shm) {
-    shm->stats_giorno.piatti_primi_avanzati = 0;
-    shm->stats_giorno.piatti_secondi_avanzati = 0;
-    for (int i = 0; i < shm->menu_primi_count; i++)
-        shm->stats_giorno.piatti_primi_avanzati += shm->st_primi.porzioni[i];
-
-    for (int i = 0; i < shm->menu_secondi_count; i++)
-        shm->stats_giorno.piatti_secondi_avanzati += shm->st_secondi.porzioni[i];
-}
\ No newline at end of file
+    stats_t *day = &shm->stats_giorno;
+
+    day->piatti_primi_avanzati = 0;
+    day->piatti_secondi_avanzati = 0;
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < menu_count(s); i++) {
+            piatto_stats_t *p = &menu_giorno[dish_slot(s, i)];
+            p->avanzati = *dish_portions(s, i);
+            if (s == 0)
+                day->piatti_primi_avanzati += p->avanzati;
+            else
+                day->piatti_secondi_avanzati += p->avanzati;
+        }
+    }
+}
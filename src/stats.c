@@ -1,7 +1,10 @@
 #include <stdio.h>
+#include <math.h>
 #include <string.h>
 #include "shared_structs.h"
 #include "stats.h"
+#include "simclock.h"
+#include "menu.h"
 
 void stats_reset_day(stats_t *s) {
     memset(s, 0, sizeof(stats_t));
@@ -24,12 +27,173 @@ void stats_update_totals(stats_t *tot, stats_t *day) {
     tot->tempo_attesa_coffee_ns  += day->tempo_attesa_coffee_ns;
     tot->tempo_attesa_cassa_ns   += day->tempo_attesa_cassa_ns;
 
+    tot->richieste_primi   += day->richieste_primi;
+    tot->richieste_secondi += day->richieste_secondi;
+    tot->richieste_coffee  += day->richieste_coffee;
+    tot->richieste_cassa   += day->richieste_cassa;
+
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        tot->rinunce_arrivo[i] += day->rinunce_arrivo[i];
+        tot->abbandoni_coda[i] += day->abbandoni_coda[i];
+    }
+
+    tot->utenti_respinti    += day->utenti_respinti;
+    tot->utenti_ammessi     += day->utenti_ammessi;
+    tot->attesa_ingresso_ns += day->attesa_ingresso_ns;
+
+    for (int i = 0; i < NUM_STATIONS; i++)
+        for (int c = 0; c < ATTESA_CLASSI; c++)
+            tot->attese_hist[i][c] += day->attese_hist[i][c];
+
+    for (int s = 0; s < 2; s++) {
+        for (int f = 0; f < FASCE_REFILL; f++)
+            tot->richieste_fascia[s][f] += day->richieste_fascia[s][f];
+    }
+
+    tot->gruppi_serviti         += day->gruppi_serviti;
+    tot->tempo_gruppo_ns        += day->tempo_gruppo_ns;
+    tot->attesa_posti_gruppo_ns += day->attesa_posti_gruppo_ns;
+
+    tot->tempo_percorso_ns += day->tempo_percorso_ns;
+    tot->utenti_percorso   += day->utenti_percorso;
+
     tot->operatori_attivi += day->operatori_attivi;
     tot->pause_totali     += day->pause_totali;
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        tot->richieste_ripetute[i] += day->richieste_ripetute[i];
+        tot->pausa_ns[i]    += day->pausa_ns[i];
+        tot->capacita_ns[i] += day->capacita_ns[i];
+    }
 
     tot->ricavo_giornaliero += day->ricavo_giornaliero;
 }
 
+/* Rinunce per stazione (BALKQUEUE / PATIENCEMEAN), solo se presenti */
+static void print_rinunce(stats_t *s) {
+    static const char *nomi[NUM_STATIONS] = { "primi", "secondi", "coffee", "cassa" };
+    int totale = 0;
+
+    for (int i = 0; i < NUM_STATIONS; i++)
+        totale += s->rinunce_arrivo[i] + s->abbandoni_coda[i];
+    if (totale == 0)
+        return;
+
+    printf("\nRinunce (coda lunga all'arrivo / pazienza esaurita):\n");
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        printf("  Stazione %-8s         %d / %d\n", nomi[i],
+               s->rinunce_arrivo[i], s->abbandoni_coda[i]);
+    }
+}
+
+/* Percentile dall'istogramma: limite superiore della classe che lo contiene */
+static double attesa_percentile(const int *hist, int totale, double p) {
+    long soglia = (long)ceil(p * totale), cumulati = 0;
+
+    for (int c = 0; c < ATTESA_CLASSI; c++) {
+        cumulati += hist[c];
+        if (cumulati >= soglia)
+            return pow(2.0, (double)(c + 1) / ATTESA_SUDDIVISIONI) - 1.0;
+    }
+    return pow(2.0, (double)ATTESA_CLASSI / ATTESA_SUDDIVISIONI) - 1.0;
+}
+
+/* Coda delle attese per stazione, con la disciplina usata */
+static void print_attese_coda(stats_t *s) {
+    static const char *nomi[NUM_STATIONS] = { "primi", "secondi", "coffee", "cassa" };
+    static const char *discipline[] = { "FIFO", "SJF", "priorita'" };
+
+    printf("  Percentili p50 / p95 / p99 (s simulati):\n");
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        int totale = 0;
+        for (int c = 0; c < ATTESA_CLASSI; c++)
+            totale += s->attese_hist[i][c];
+        if (totale == 0)
+            continue;
+
+        printf("    %-8s %-10s %7.1f / %7.1f / %7.1f\n", nomi[i],
+               discipline[shm->QUEUEDISCIPLINE[i]],
+               attesa_percentile(s->attese_hist[i], totale, 0.50),
+               attesa_percentile(s->attese_hist[i], totale, 0.95),
+               attesa_percentile(s->attese_hist[i], totale, 0.99));
+    }
+}
+
+/* ---------------------------------------------------------
+   Bilancio per piatto: richieste, porzioni al mattino + rifornite,
+   servite, chieste a piatto esaurito, avanzate. Per la giornata si
+   riporta il minuto del primo esaurimento, nei totali i giorni con
+   esaurimento. Seguono le richieste ripetute dagli utenti dopo un
+   piatto esaurito, traffico in piu' sulle code delle stazioni.
+   --------------------------------------------------------- */
+static void print_piatti(stats_t *s, int totali) {
+    static const char *stazioni[2] = { "Primi", "Secondi" };
+    piatto_stats_t *piatti = totali ? menu_totale : menu_giorno;
+
+    printf("\nPiatti (richieste / mattino+riforniti / serviti / mancati / avanzati / %s):\n",
+           totali ? "giorni esaurito" : "esaurito al min");
+    for (int k = 0; k < 2; k++) {
+        int richieste = 0;
+
+        printf("  %s\n", stazioni[k]);
+        for (int i = 0; i < menu_count(k); i++) {
+            piatto_stats_t *p = &piatti[dish_slot(k, i)];
+            richieste += p->richieste;
+
+            printf("    %-22.22s %5d / %5d+%-5d / %5d / %5d / %5d / ", dish_name(k, i),
+                   p->richieste, p->stock, p->riforniti, p->serviti, p->rifiuti,
+                   p->avanzati);
+            if (totali)
+                printf("%d\n", p->giorni_esaurito);
+            else if (p->esaurito_min > 0)
+                printf("%d\n", p->esaurito_min - 1);
+            else
+                printf("-\n");
+        }
+
+        printf("    Richieste ripetute dopo un esaurimento: %d (%.1f%% del traffico)\n",
+               s->richieste_ripetute[k],
+               richieste ? 100.0 * s->richieste_ripetute[k] / richieste : 0.0);
+    }
+}
+
+/* Capacita' di servizio persa per le pause, per stazione */
+static void print_capacita_persa(stats_t *s) {
+    static const char *nomi[NUM_STATIONS] = { "primi", "secondi", "coffee", "cassa" };
+
+    if (s->pause_totali == 0)
+        return;
+
+    printf("Capacita' persa per pause (minuti di postazione):\n");
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        double persa = sim_ns_to_sec(s->pausa_ns[i]) / 60.0;
+        double perc = s->capacita_ns[i] ? 100.0 * s->pausa_ns[i] / s->capacita_ns[i] : 0.0;
+        printf("  Stazione %-8s         %.1f (%.1f%%)\n", nomi[i], persa, perc);
+    }
+}
+
+/* Porta della mensa (GATEMODE), solo se qualcuno e' passato dal controllo */
+static void print_ingresso(stats_t *s) {
+    if (s->utenti_ammessi == 0 && s->utenti_respinti == 0)
+        return;
+
+    printf("Utenti respinti alla porta: %d\n", s->utenti_respinti);
+    printf("Attesa media alla porta:   %.1f s simulati (%d ammessi)\n",
+           s->utenti_ammessi ? sim_ns_to_sec(s->attesa_ingresso_ns) / s->utenti_ammessi : 0.0,
+           s->utenti_ammessi);
+}
+
+/* Tempi dei gruppi (GROUPWEIGHTS), solo se ne sono stati serviti */
+static void print_gruppi(stats_t *s) {
+    if (s->gruppi_serviti == 0)
+        return;
+
+    printf("\nGruppi serviti:            %d\n", s->gruppi_serviti);
+    printf("  Arrivo-pagamento medio:  %.1f s simulati\n",
+           sim_ns_to_sec(s->tempo_gruppo_ns) / s->gruppi_serviti);
+    printf("  Attesa posti adiacenti:  %.1f s simulati\n",
+           sim_ns_to_sec(s->attesa_posti_gruppo_ns) / s->gruppi_serviti);
+}
+
 void stats_print_day(stats_t *s, int day) {
 
     printf("\n================== STATISTICHE GIORNO %d ==================\n", day);
@@ -37,6 +201,7 @@ void stats_print_day(stats_t *s, int day) {
     printf("Utenti serviti:            %d\n", s->utenti_serviti);
     printf("Utenti non serviti:        %d\n", s->utenti_non_serviti);
     printf("Utenti in attesa (fine giornata): %d\n", s->utenti_in_attesa);
+    print_ingresso(s);
 
     printf("\nPiatti serviti:\n");
     printf("  Primi:                   %d\n", s->piatti_primi_serviti);
@@ -46,21 +211,28 @@ void stats_print_day(stats_t *s, int day) {
     printf("\nPiatti avanzati:\n");
     printf("  Primi:                   %d\n", s->piatti_primi_avanzati);
     printf("  Secondi:                 %d\n", s->piatti_secondi_avanzati);
+    print_piatti(s, 0);
 
-    printf("\nTempi medi di attesa (ms):\n");
+    printf("\nTempi medi di attesa (secondi simulati):\n");
 
-    long avg_primi   = s->utenti_serviti ? s->tempo_attesa_primi_ns   / 1000000 / s->utenti_serviti : 0;
-    long avg_secondi = s->utenti_serviti ? s->tempo_attesa_secondi_ns / 1000000 / s->utenti_serviti : 0;
-    long avg_coffee  = s->utenti_serviti ? s->tempo_attesa_coffee_ns  / 1000000 / s->utenti_serviti : 0;
-    long avg_cassa   = s->utenti_serviti ? s->tempo_attesa_cassa_ns   / 1000000 / s->utenti_serviti : 0;
+    double avg_primi   = s->utenti_serviti ? sim_ns_to_sec(s->tempo_attesa_primi_ns)   / s->utenti_serviti : 0;
+    double avg_secondi = s->utenti_serviti ? sim_ns_to_sec(s->tempo_attesa_secondi_ns) / s->utenti_serviti : 0;
+    double avg_coffee  = s->utenti_serviti ? sim_ns_to_sec(s->tempo_attesa_coffee_ns)  / s->utenti_serviti : 0;
+    double avg_cassa   = s->utenti_serviti ? sim_ns_to_sec(s->tempo_attesa_cassa_ns)   / s->utenti_serviti : 0;
 
-    printf("  Stazione primi:          %ld ms\n", avg_primi);
-    printf("  Stazione secondi:        %ld ms\n", avg_secondi);
-    printf("  Stazione coffee:         %ld ms\n", avg_coffee);
-    printf("  Cassa:                   %ld ms\n", avg_cassa);
+    printf("  Stazione primi:          %.1f s\n", avg_primi);
+    printf("  Stazione secondi:        %.1f s\n", avg_secondi);
+    printf("  Stazione coffee:         %.1f s\n", avg_coffee);
+    printf("  Cassa:                   %.1f s\n", avg_cassa);
+    printf("  Arrivo-pagamento:        %.1f s\n", s->utenti_percorso ?
+           sim_ns_to_sec(s->tempo_percorso_ns) / s->utenti_percorso : 0.0);
+    print_attese_coda(s);
+    print_rinunce(s);
+    print_gruppi(s);
 
     printf("\nOperatori attivi:          %d\n", s->operatori_attivi);
     printf("Pause totali:              %d\n", s->pause_totali);
+    print_capacita_persa(s);
 
     printf("\nRicavo giornaliero:        %.2f €\n", s->ricavo_giornaliero);
 
@@ -74,6 +246,7 @@ void stats_print_final(stats_t *tot, int giorni) {
     printf("\nUTENTI:\n");
     printf("Utenti serviti totali:     %d\n", tot->utenti_serviti);
     printf("Utenti non serviti totali: %d\n", tot->utenti_non_serviti);
+    print_ingresso(tot);
     if (giorni > 0) {
         printf("Utenti serviti in media al giorno:     %.2f\n", 
                (double)tot->utenti_serviti / giorni);
@@ -109,32 +282,41 @@ void stats_print_final(stats_t *tot, int giorni) {
         printf("  Primi:                 %.2f\n", (double)tot->piatti_primi_avanzati / giorni);
         printf("  Secondi:               %.2f\n", (double)tot->piatti_secondi_avanzati / giorni);
     }
+    print_piatti(tot, 1);
 
     printf("\nTEMPI MEDI DI ATTESA:\n");
     
     if (tot->utenti_serviti > 0) {
-        long avg_primi   = tot->tempo_attesa_primi_ns   / 1000000 / tot->utenti_serviti;
-        long avg_secondi = tot->tempo_attesa_secondi_ns / 1000000 / tot->utenti_serviti;
-        long avg_coffee  = tot->tempo_attesa_coffee_ns  / 1000000 / tot->utenti_serviti;
-        long avg_cassa   = tot->tempo_attesa_cassa_ns   / 1000000 / tot->utenti_serviti;
+        double avg_primi   = sim_ns_to_sec(tot->tempo_attesa_primi_ns)   / tot->utenti_serviti;
+        double avg_secondi = sim_ns_to_sec(tot->tempo_attesa_secondi_ns) / tot->utenti_serviti;
+        double avg_coffee  = sim_ns_to_sec(tot->tempo_attesa_coffee_ns)  / tot->utenti_serviti;
+        double avg_cassa   = sim_ns_to_sec(tot->tempo_attesa_cassa_ns)   / tot->utenti_serviti;
         
-        long avg_complessivo = (avg_primi + avg_secondi + avg_coffee + avg_cassa) / 4;
+        double avg_complessivo = (avg_primi + avg_secondi + avg_coffee + avg_cassa) / 4;
         
-        printf("Tempo medio complessivo:     %ld ms\n", avg_complessivo);
-        printf("  Stazione primi:            %ld ms\n", avg_primi);
-        printf("  Stazione secondi:          %ld ms\n", avg_secondi);
-        printf("  Stazione coffee:           %ld ms\n", avg_coffee);
-        printf("  Cassa:                     %ld ms\n", avg_cassa);
+        printf("Tempo medio complessivo:     %.1f s simulati\n", avg_complessivo);
+        printf("  Stazione primi:            %.1f s\n", avg_primi);
+        printf("  Stazione secondi:          %.1f s\n", avg_secondi);
+        printf("  Stazione coffee:           %.1f s\n", avg_coffee);
+        printf("  Cassa:                     %.1f s\n", avg_cassa);
+        if (tot->utenti_percorso > 0)
+            printf("Permanenza media arrivo-pagamento: %.1f s simulati\n",
+                   sim_ns_to_sec(tot->tempo_percorso_ns) / tot->utenti_percorso);
+        print_attese_coda(tot);
     } else {
         printf("Nessun utente servito\n");
     }
 
+    print_rinunce(tot);
+    print_gruppi(tot);
+
     printf("\nOPERATORI:\n");
     printf("Operatori attivi totali:     %d\n", tot->operatori_attivi);
     printf("Pause totali:                %d\n", tot->pause_totali);
     if (giorni > 0) {
         printf("Pause medie per giornata:    %.2f\n", (double)tot->pause_totali / giorni);
     }
+    print_capacita_persa(tot);
 
     printf("\nRICAVI:\n");
     printf("Ricavo totale:               %.2f €\n", tot->ricavo_giornaliero);
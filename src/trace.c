@@ -0,0 +1,82 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shared_structs.h"
+#include "trace.h"
+
+trace_hdr_t *trace_hdr  = NULL;
+trace_rec_t *trace_recs = NULL;
+
+static int    trace_fd = -1;
+static size_t trace_map_size = 0;
+
+/* ---------------------------------------------------------
+   Apertura del file di traccia del processo
+   Il file viene dimensionato per TRACEMAXEVENTS record e mappato
+   in memoria: scrivere un evento e' una semplice store, le pagine
+   non toccate restano sparse sul disco
+   --------------------------------------------------------- */
+void trace_open(shm_t *shm, int proc_kind, int proc_id) {
+    if (!shm->TRACE || shm->TRACEMAXEVENTS <= 0)
+        return;
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s_%d.bin", shm->TRACEDIR,
+             proc_kind == TRACE_PROC_OPERATORE ? "operatore" : "utente", proc_id);
+
+    trace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0) {
+        perror("[TRACE] open");
+        return;
+    }
+
+    trace_map_size = sizeof(trace_hdr_t) + (size_t)shm->TRACEMAXEVENTS * sizeof(trace_rec_t);
+    if (ftruncate(trace_fd, trace_map_size) < 0) {
+        perror("[TRACE] ftruncate");
+        close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+
+    void *p = mmap(NULL, trace_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, trace_fd, 0);
+    if (p == MAP_FAILED) {
+        perror("[TRACE] mmap");
+        close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+
+    trace_hdr  = p;
+    trace_recs = (trace_rec_t *)((char *)p + sizeof(trace_hdr_t));
+
+    trace_hdr->magic     = TRACE_MAGIC;
+    trace_hdr->version   = TRACE_VERSION;
+    trace_hdr->rec_size  = sizeof(trace_rec_t);
+    trace_hdr->proc_kind = proc_kind;
+    trace_hdr->proc_id   = proc_id;
+    trace_hdr->capacity  = shm->TRACEMAXEVENTS;
+    trace_hdr->count     = 0;
+    trace_hdr->dropped   = 0;
+}
+
+/* Chiusura: il file viene ridotto ai soli record scritti */
+void trace_close(void) {
+    if (trace_hdr == NULL)
+        return;
+
+    size_t used = sizeof(trace_hdr_t) + trace_hdr->count * sizeof(trace_rec_t);
+
+    munmap(trace_hdr, trace_map_size);
+    trace_hdr  = NULL;
+    trace_recs = NULL;
+
+    if (ftruncate(trace_fd, used) < 0)
+        perror("[TRACE] ftruncate");
+    close(trace_fd);
+    trace_fd = -1;
+}
@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/* ---------------------------------------------------------
+   Decodifica dei file di traccia binari in CSV su stdout
+   Uso: trace_decode trace/operatore_0.bin trace/utente_0.bin ... > trace.csv
+   --------------------------------------------------------- */
+
+static const char *event_name(int ev) {
+    switch (ev) {
+        case TR_ENQUEUE:       return "enqueue";
+        case TR_SERVICE_START: return "service_start";
+        case TR_SERVICE_END:   return "service_end";
+        case TR_DISH_OUTCOME:  return "dish_outcome";
+        case TR_PAYMENT:       return "payment";
+        case TR_SEAT_ACQUIRED: return "seat_acquired";
+        case TR_SEAT_RELEASED: return "seat_released";
+    }
+    return "unknown";
+}
+
+static int decode_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    trace_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_MAGIC) {
+        fprintf(stderr, "[TRACE] %s: intestazione non valida\n", path);
+        fclose(f);
+        return -1;
+    }
+    if (hdr.version != TRACE_VERSION || hdr.rec_size != sizeof(trace_rec_t)) {
+        fprintf(stderr, "[TRACE] %s: versione %u non supportata\n", path, hdr.version);
+        fclose(f);
+        return -1;
+    }
+
+    const char *kind = hdr.proc_kind == TRACE_PROC_OPERATORE ? "operatore" : "utente";
+    trace_rec_t r;
+
+    for (uint64_t i = 0; i < hdr.count; i++) {
+        if (fread(&r, sizeof(r), 1, f) != 1)
+            break;
+        printf("%s,%d,%llu,%u,%s,%u,%u,%u\n", kind, hdr.proc_id,
+               (unsigned long long)r.ts_ns, (unsigned)r.user_id, event_name(r.event),
+               r.station, r.esito, (unsigned)r.piatto);
+    }
+
+    if (hdr.dropped > 0)
+        fprintf(stderr, "[TRACE] %s: %llu eventi persi (TRACEMAXEVENTS troppo basso)\n",
+                path, (unsigned long long)hdr.dropped);
+
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Uso: trace_decode <file.bin>...\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("proc,proc_id,ts_ns,user_id,event,station,esito,piatto\n");
+
+    int errors = 0;
+    for (int i = 1; i < argc; i++) {
+        if (decode_file(argv[i]) < 0)
+            errors++;
+    }
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
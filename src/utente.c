@@ -8,12 +8,24 @@
 #include <string.h>
 #include <errno.h>
 #include <stddef.h>
+#include <math.h>
+#include <assert.h>
 #include "shared_structs.h"
 #include "ipc.h"
 #include "util.h"
+#include "log.h"
+#include "trace.h"
+#include "profile.h"
+#include "lockprof.h"
+#include "simclock.h"
+#include "groups.h"
+#include "menu.h"
+#include "barrier.h"
 
 extern shm_t *shm;
 
+#define PASTO_MINUTI_PIATTO 5   // minuti simulati per consumare un piatto
+
 static int user_id = -1;
 
 static int want_primo   = 1;
@@ -24,13 +36,31 @@ static int got_primo   = 0;
 static int got_secondo = 0;
 static int got_coffee  = 0;
 
+/* Pazienza in coda e rinunce della giornata */
+#define RINUNCIA            -1      // esito di go_to_station: l'utente ha lasciato la coda
+static uint64_t pazienza_ns = 0;    // 0 = attesa illimitata
+static int ha_rinunciato = 0;
+static int ammesso = 0;             // utenti fatti entrare dalla porta oggi
+static uint16_t req_seq = 0;
+
+/* Gruppi (GROUPWEIGHTS): il capogruppo percorre la mensa per tutti */
+static int membri = 1;              // 0 = membro di un gruppo, >1 = capogruppo
+static int in_percorso = 1;         // utenti ancora nel percorso della giornata
+
 static void user_init();
 static void user_loop(void);
 static int  end_day_while_waiting(void);
-static int  go_to_station(int station_type, int piatto);
-static int  try_all_dishes_of_type(int station_type, int max_types);
-static int  go_to_cassa(void);
-static void go_to_tavolo_and_eat(void);
+static void wait_end_of_day(void);
+static void wait_arrival(void);
+static void draw_patience(void);
+static int  enter_canteen(int n);
+static int  go_to_station(int station_type, int piatto, int quantita, int ripetuta);
+static void preorder_stations(void);
+static int  try_all_dishes_of_type(int station_type, int max_types, int quantita);
+static int  go_to_cassa(int n_primi, int n_secondi, int n_coffee, int quantita);
+static int  go_to_tavolo_and_eat(int posti, int minuti, long *attesa_posti_ns);
+static station_t *get_station(int station_type);
+static void group_day(void);
 static int  get_msg_queue(int station_type);
 
 int main(int argc, char *argv[]) {
@@ -40,24 +70,40 @@ int main(int argc, char *argv[]) {
     }
     user_id = atoi(argv[1]);
     shm = ipc_attach_shared_memory();
-    ipc_signal_ready();
-    sem_wait(&shm->sem_barrier);
+    ipc_attach_request_slots();
+    groups_attach(shm);
+    menu_attach(shm);
+    log_attach(shm, LOG_SLOT_UTENTE(user_id));
+    barrier_wait(&shm->barriera_avvio);
     user_init(user_id);
+    trace_open(shm, TRACE_PROC_UTENTE, user_id);
     user_loop();
+    trace_close();
     return 0;
 }
 
 static void user_init() {
-    srand(time(NULL) ^ (getpid() << 16));
+    if (shm->SEED != 0)
+        srand(shm->SEED * 104729u + (unsigned)user_id);    // esecuzione riproducibile
+    else
+        srand(time(NULL) ^ (getpid() << 16));
 
     want_primo   = 1;
     want_secondo = 1;
     want_coffee  = rand_range(0, 1); // opzionale
+
+    gruppo_t *g = group_of(user_id);
+    membri = g->capogruppo == user_id ? g->dimensione : 0;
 }
 
 static void user_loop(void) {
+    PROF_DECL(t_fase);
+
     while (1) {
-        sem_wait(&shm->sem_day_start);
+        PROF_START(t_fase);
+        barrier_wait(&shm->barriera_giorno);
+        PROF_END(PROF_UT_FINE_GIORNO, t_fase);
+        PROF_FLUSH(shm->prof_utente, PROF_UT_STAGES);
         
         //printf("[UTENTE %d] Giornata iniziata\n", user_id);
 
@@ -66,146 +112,443 @@ static void user_loop(void) {
             break;
         }
 
+        /* Membro di un gruppo: il capogruppo agisce per lui */
+        if (membri == 0) {
+            wait_end_of_day();
+            continue;
+        }
+        if (membri > 1) {
+            group_day();
+            continue;
+        }
+        in_percorso = 1;
+
         //l'utente vuole il primo o il secondo o entrambi
         do {
             want_primo   = rand_range(0, 1);
             want_secondo = rand_range(0, 1);
         } while (want_primo == 0 && want_secondo == 0);
         want_coffee  = rand_range(0, 1); // coffee opzionale ogni giorno
+
+        /* Domanda osservata, usata dal responsabile per assegnare gli operatori */
+        if (want_primo)   __sync_fetch_and_add(&shm->st_primi.richieste, 1);
+        if (want_secondo) __sync_fetch_and_add(&shm->st_secondi.richieste, 1);
+        if (want_coffee)  __sync_fetch_and_add(&shm->st_coffee.richieste, 1);
         
         got_primo   = 0;
         got_secondo = 0;
         got_coffee  = 0;
+        ha_rinunciato = 0;
+        draw_patience();
 
-        if (want_primo) {
-            if (!try_all_dishes_of_type(0, shm->menu_primi_count)) {
-                printf("[UTENTE %d] Nessun primo disponibile, continuo...\n", user_id);
-                want_primo = 0;
-            } else {
-                got_primo = 1;  
-            }
+        wait_arrival();
+        uint64_t t_ingresso = sim_now_ns();
+
+        if (!enter_canteen(1)) {
+            if (end_day_while_waiting() == 1) continue;
+
+            /* Respinto alla porta: non entra e non resta in attesa */
+            lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+            shm->stats_giorno.utenti_non_serviti++;
+            shm->stats_giorno.utenti_respinti++;
+            lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+
+            wait_end_of_day();
+            continue;
         }
 
-        if (end_day_while_waiting() == 1) continue;
+        if (shm->PREORDER) {
+            PROF_START(t_fase);
+            preorder_stations();
+            PROF_END(PROF_UT_PREORDINE, t_fase);
 
-        if (want_secondo) {
-            if (!try_all_dishes_of_type(1, shm->menu_secondi_count)) {
-                printf("[UTENTE %d] Nessun secondo disponibile, continuo...\n", user_id);
-                want_secondo = 0;
-            } else {
-                got_secondo = 1;  
+            if (end_day_while_waiting() == 1) continue;
+        } else {
+            if (want_primo) {
+                PROF_START(t_fase);
+                int ok = try_all_dishes_of_type(0, menu_count(PORTATA_PRIMI), 1);
+                PROF_END(PROF_UT_PRIMI, t_fase);
+                if (!ok) {
+                    LOG_INFO("[UTENTE %d] Nessun primo disponibile, continuo...\n", user_id);
+                    want_primo = 0;
+                } else {
+                    got_primo = 1;  
+                }
+            }
+
+            if (end_day_while_waiting() == 1) continue;
+
+            if (want_secondo) {
+                PROF_START(t_fase);
+                int ok = try_all_dishes_of_type(1, menu_count(PORTATA_SECONDI), 1);
+                PROF_END(PROF_UT_SECONDI, t_fase);
+                if (!ok) {
+                    LOG_INFO("[UTENTE %d] Nessun secondo disponibile, continuo...\n", user_id);
+                    want_secondo = 0;
+                } else {
+                    got_secondo = 1;  
+                }
             }
-        }
        
-        if (end_day_while_waiting() == 1) continue;
+            if (end_day_while_waiting() == 1) continue;
+        }
 
         /* Se non ha ottenuto nulla → abbandona il giorno, ma resta per i successivi */
         if (!want_primo && !want_secondo) {
-            printf("[UTENTE %d] Nessun piatto disponibile (primi e secondi esauriti), abbandono il giorno\n", user_id);
-            sem_wait(&shm->sem_stats);
+            LOG_INFO("[UTENTE %d] Nessun piatto disponibile (primi e secondi esauriti), abbandono il giorno\n", user_id);
+            lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
             shm->stats_giorno.utenti_non_serviti++;
-            shm->stats_giorno.utenti_in_attesa++;
-            sem_post(&shm->sem_stats);
+            if (!ha_rinunciato)
+                shm->stats_giorno.utenti_in_attesa++;   // chi ha rinunciato e' uscito dalla mensa
+            lock_post(&shm->sem_stats, &shm->sem_stats_stat);
             
-            __sync_fetch_and_add(&shm->day_barrier_count, 1);
-            while (shm->day_barrier_count < shm->NOFUSERS && shm->simulation_running) {
-                nanosleep(&(struct timespec){0, 10000000}, NULL);
-            }
+            wait_end_of_day();
             continue;
         }
 
-        if (want_coffee) {
-            if (go_to_station(2, 0)) {
+        if (want_coffee && !shm->PREORDER) {
+            PROF_START(t_fase);
+            if (go_to_station(2, 0, 1, 0) == 1) {
                 got_coffee = 1;  
             }
+            PROF_END(PROF_UT_COFFEE, t_fase);
         }
 
         if (end_day_while_waiting() == 1) continue;
 
-        if (!go_to_cassa()) {
+        __sync_fetch_and_add(&shm->st_cassa.richieste, 1);
+        PROF_START(t_fase);
+        int pagato = go_to_cassa(got_primo, got_secondo, got_coffee, 1);
+        PROF_END(PROF_UT_CASSA, t_fase);
+        if (!pagato) {
             if(shm->simulation_running) {
-                printf("[UTENTE %d] Impossibile pagare, abbandono il giorno\n", user_id);
+                LOG_INFO("[UTENTE %d] Impossibile pagare, abbandono il giorno\n", user_id);
             }
-            sem_wait(&shm->sem_stats);
+            lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
             shm->stats_giorno.utenti_non_serviti++;
             shm->stats_giorno.utenti_in_attesa++;
-            sem_post(&shm->sem_stats);
+            lock_post(&shm->sem_stats, &shm->sem_stats_stat);
 
-            __sync_fetch_and_add(&shm->day_barrier_count, 1);
-            while (shm->day_barrier_count < shm->NOFUSERS && shm->simulation_running) {
-                nanosleep(&(struct timespec){0, 10000000}, NULL);
-            }
+            wait_end_of_day();
             continue;
         }
 
+        /* Tempo di permanenza dall'arrivo al pagamento */
+        __sync_fetch_and_add(&shm->stats_giorno.tempo_percorso_ns, (long)(sim_now_ns() - t_ingresso));
+        __sync_fetch_and_add(&shm->stats_giorno.utenti_percorso, 1);
+
         if (end_day_while_waiting() == 1) continue;
 
-        go_to_tavolo_and_eat();
+        int piatti = got_primo + got_secondo + got_coffee;
+        if (!go_to_tavolo_and_eat(1, piatti * PASTO_MINUTI_PIATTO, NULL)) {
+            wait_end_of_day();
+            continue;
+        }
 
-        __sync_fetch_and_add(&shm->day_barrier_count, 1);
-        printf("[UTENTE %d] Ha finito e lascia la mensa per oggi\n", user_id);
+        LOG_INFO("[UTENTE %d] Ha finito e lascia la mensa per oggi\n", user_id);
         
-        sem_wait(&shm->sem_stats);
+        lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
         shm->stats_giorno.utenti_serviti++;
-        sem_post(&shm->sem_stats);
-        while (shm->day_barrier_count < shm->NOFUSERS && shm->simulation_running) {
-            nanosleep(&(struct timespec){0, 10000000}, NULL);
-        }
+        lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+        wait_end_of_day();
+    }
+}
+
+/* Esce dalla mensa per oggi: l'attesa degli altri e' la barriera
+   della giornata, all'inizio di user_loop() */
+static void wait_end_of_day(void) {
+    if (ammesso) {
+        __sync_fetch_and_sub(&shm->ingresso.in_mensa, ammesso);
+        ammesso = 0;
+    }
+}
+
+/* ---------------------------------------------------------
+   Istante di arrivo in mensa, in minuti simulati dall'apertura
+   Condizionati al numero di utenti, gli arrivi di un processo di
+   Poisson sono indipendenti e uniformi nella finestra; con il picco
+   il tasso e' costante a tratti, quindi si sceglie la fascia con
+   probabilita' proporzionale al suo peso e poi un istante uniforme
+   --------------------------------------------------------- */
+static double draw_arrival_minute(void) {
+    double finestra = shm->ARRIVALWINDOW;
+    double u = (double)rand() / ((double)RAND_MAX + 1.0);
+
+    if (shm->ARRIVALMODE == ARRIVI_POISSON)
+        return u * finestra;
+
+    static const int curva[ARRIVI_SLOT] = CURVA_ARRIVI;
+    int somma = 0;
+    for (int i = 0; i < ARRIVI_SLOT; i++)
+        somma += curva[i];
+
+    int r = rand_range(1, somma);
+    int slot = 0;
+    while (r > curva[slot]) {
+        r -= curva[slot];
+        slot++;
+    }
+
+    double durata_slot = finestra / ARRIVI_SLOT;
+    return (slot + u) * durata_slot;
+}
+
+/* Attende, senza polling, l'istante di arrivo della giornata */
+static void wait_arrival(void) {
+    if (shm->ARRIVALMODE == ARRIVI_INSIEME)
+        return;
+
+    uint64_t arrivo = shm->inizio_giorno_ns + sim_min_to_ns(draw_arrival_minute());
+    uint64_t ora = sim_now_ns();
+    if (arrivo > ora)
+        sim_sleep_ns((long)(arrivo - ora));
+}
+
+/* Condizione di ammissione per gli n utenti in testa alla coda della porta */
+static int gate_open(int n) {
+    ingresso_t *in = &shm->ingresso;
+
+    if (shm->GATEMAXQUEUE > 0) {
+        int in_coda = shm->st_primi.utenti_in_coda + shm->st_secondi.utenti_in_coda +
+                      shm->st_coffee.utenti_in_coda + shm->st_cassa.utenti_in_coda;
+        if (in_coda >= shm->GATEMAXQUEUE)
+            return 0;
+    }
+
+    /* Un gruppo entra tutto insieme; a mensa vuota entra comunque */
+    if (shm->GATEMODE == INGRESSO_MAX_DENTRO)
+        return in->in_mensa + n <= in->limite || in->in_mensa == 0;
+
+    /* Token bucket: ricarica proporzionale al tempo simulato trascorso */
+    uint64_t ora = sim_now_ns();
+    uint64_t minuto_ns = sim_min_to_ns(1);
+    if (minuto_ns > 0 && ora > in->ultima_ricarica_ns) {
+        in->gettoni += shm->GATERATE * (double)(ora - in->ultima_ricarica_ns) / minuto_ns;
+        if (in->gettoni > shm->GATEBURST)
+            in->gettoni = shm->GATEBURST;
+    }
+    in->ultima_ricarica_ns = ora;
+
+    /* Un gruppo piu' grande di GATEBURST entra a secchio pieno */
+    double servono = n < shm->GATEBURST ? n : shm->GATEBURST;
+    if (servono < 1.0)
+        servono = 1.0;
+    if (in->gettoni < servono)
+        return 0;
+    in->gettoni -= n;
+    return 1;
+}
+
+/* ---------------------------------------------------------
+   Porta della mensa (GATEMODE): l'utente prende un biglietto e
+   attende il proprio turno in ordine di arrivo; solo chi e' in testa
+   valuta la condizione di ammissione, quindi lo stato della porta
+   non ha bisogno di un mutex. Se la coda alla porta e' gia' lunga
+   GATEMAXLINE l'utente viene respinto senza entrare in coda.
+   Un gruppo di n utenti occupa un solo biglietto ed entra insieme.
+   Ritorna 1 se ammesso, 0 se respinto o a giornata finita.
+   --------------------------------------------------------- */
+static int enter_canteen(int n) {
+    ingresso_t *in = &shm->ingresso;
+
+    if (shm->GATEMODE == INGRESSO_LIBERO)
+        return 1;
+
+    uint64_t t_porta = sim_now_ns();
+    unsigned int biglietto;
+
+    if (shm->GATEMAXLINE > 0) {
+        /* Il controllo della lunghezza e il biglietto sono una sola CAS
+           sulla coda: arrivi concorrenti non superano GATEMAXLINE */
+        do {
+            biglietto = __atomic_load_n(&in->prossimo_biglietto, __ATOMIC_ACQUIRE);
+            if ((int)(biglietto - __atomic_load_n(&in->biglietto_servito, __ATOMIC_ACQUIRE)) >=
+                shm->GATEMAXLINE) {
+                LOG_INFO("[UTENTE %d] Coda alla porta troppo lunga, respinto\n", user_id);
+                return 0;
+            }
+        } while (!__sync_bool_compare_and_swap(&in->prossimo_biglietto, biglietto, biglietto + 1));
+    } else {
+        biglietto = __sync_fetch_and_add(&in->prossimo_biglietto, 1);
+    }
+
+    while (__atomic_load_n(&in->biglietto_servito, __ATOMIC_ACQUIRE) != biglietto ||
+           !gate_open(n)) {
+        if (!shm->simulation_running)
+            return 0;
+        sim_poll(1);
     }
+
+    __sync_fetch_and_add(&in->in_mensa, n);
+    ammesso = n;
+    __atomic_store_n(&in->biglietto_servito, biglietto + 1, __ATOMIC_RELEASE);
+
+    __sync_fetch_and_add(&shm->stats_giorno.utenti_ammessi, n);
+    __sync_fetch_and_add(&shm->stats_giorno.attesa_ingresso_ns, (long)(sim_now_ns() - t_porta) * n);
+    return 1;
 }
 
 static int end_day_while_waiting() {
     if (!shm->simulation_running) {
-        sem_wait(&shm->sem_stats);
-        shm->stats_giorno.utenti_non_serviti++;
-        shm->stats_giorno.utenti_in_attesa++;
-        sem_post(&shm->sem_stats);
+        lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+        shm->stats_giorno.utenti_non_serviti += in_percorso;
+        shm->stats_giorno.utenti_in_attesa += in_percorso;
+        lock_post(&shm->sem_stats, &shm->sem_stats_stat);
         
-        __sync_fetch_and_add(&shm->day_barrier_count, 1);
-        while (shm->day_barrier_count < shm->NOFUSERS && shm->simulation_running) {
-            nanosleep(&(struct timespec){0, 10000000}, NULL);
-        }
+        wait_end_of_day();
         return 1;
     }
     return 0;
 }
 
+/* Pazienza della giornata: esponenziale di media PATIENCEMEAN minuti */
+static void draw_patience(void) {
+    if (shm->PATIENCEMEAN <= 0) {
+        pazienza_ns = 0;
+        return;
+    }
+    double u = (double)rand() / ((double)RAND_MAX + 1.0);
+    pazienza_ns = sim_min_to_ns(-shm->PATIENCEMEAN * log(1.0 - u));
+    if (pazienza_ns == 0)
+        pazienza_ns = 1;
+}
+
+static station_t *get_station(int station_type) {
+    switch (station_type) {
+        case 0: return &shm->st_primi;
+        case 1: return &shm->st_secondi;
+        case 2: return &shm->st_coffee;
+        case 3: return &shm->st_cassa;
+    }
+    return NULL;
+}
+
+/* Rinuncia all'arrivo se la coda visibile e' troppo lunga */
+static int balk_at_station(int station_type) {
+    if (shm->BALKQUEUE <= 0 ||
+        get_station(station_type)->utenti_in_coda < shm->BALKQUEUE)
+        return 0;
+
+    LOG_INFO("[UTENTE %d] Coda troppo lunga alla stazione %d, rinuncio\n",
+             user_id, station_type);
+    __sync_fetch_and_add(&get_station(station_type)->rinunce_arrivo, 1);
+    ha_rinunciato = 1;
+    return 1;
+}
+
+/* Segna la richiesta come in coda nello slot dell'utente */
+static uint16_t enqueue_slot(int station_type) {
+    req_seq = (req_seq + 1) & REQ_SEQ_MASK;
+    REQ_SLOT(user_id, station_type) = REQ_WORD(req_seq, REQ_IN_ATTESA);
+    __sync_fetch_and_add(&get_station(station_type)->utenti_in_coda, 1);
+    return req_seq;
+}
+
 /* ---------------------------------------------------------
-   Richiesta piatto a una stazione
+   Abbandono della coda a pazienza esaurita: riesce solo se nessun
+   operatore ha ancora preso la richiesta (CAS IN_ATTESA -> ANNULLATA),
+   altrimenti l'utente attende comunque la risposta
    --------------------------------------------------------- */
-static int go_to_station(int station_type, int piatto) {
-    msg_request_t  req;
-    msg_response_t res;
+static int renege_from_station(int station_type, uint16_t seq) {
+    if (!__sync_bool_compare_and_swap(&REQ_SLOT(user_id, station_type),
+                                      REQ_WORD(seq, REQ_IN_ATTESA),
+                                      REQ_WORD(seq, REQ_ANNULLATA)))
+        return 0;
+
+    LOG_INFO("[UTENTE %d] Pazienza esaurita, lascio la coda della stazione %d\n",
+             user_id, station_type);
+    __sync_fetch_and_sub(&get_station(station_type)->utenti_in_coda, 1);
+    __sync_fetch_and_add(&get_station(station_type)->abbandoni_coda, 1);
+    ha_rinunciato = 1;
+    return 1;
+}
+
+/* Invia la richiesta di quantita porzioni di un piatto alla coda della stazione */
+static int send_station_request(int station_type, int piatto, int quantita, int ripetuta, uint16_t *seq) {
+    msg_request_t req;
 
     int msgid = get_msg_queue(station_type);
 
     memset(&req, 0, sizeof(req));
-    req.mtype         = 1;          // tipo generico per la stazione
     req.user_id       = user_id;
     req.richiesta_tipo= station_type;
     req.piatto_scelto = piatto;
-    clock_gettime(CLOCK_REALTIME, &req.t_arrivo);
+    req.quantita      = quantita;
+    req.ripetuta      = ripetuta;
+    req.seq           = *seq = enqueue_slot(station_type);
+    assert(req.seq == *seq);    // il campo del messaggio non tronca il contatore
+    req.t_arrivo_ns = sim_now_ns();
+    req.mtype       = ipc_request_mtype(station_type, user_id, quantita, req.t_arrivo_ns);
 
     size_t req_size = MSG_REQ_SIZE;
     if (msgsnd(msgid, &req, req_size, 0) < 0) {
         perror("[UTENTE] msgsnd");
         return 0;
     }
+    trace_event(TR_ENQUEUE, user_id, station_type, 0, piatto);
+    return 1;
+}
+
+/* Registra l'esito di una risposta: porzioni servite, 0 se nessuna */
+static int station_outcome(int station_type, int piatto, msg_response_t *res) {
+    trace_event(TR_DISH_OUTCOME, user_id, station_type, res->esito, piatto);
+
+    /* Gestione esito */
+    if (res->esito == 0) {
+        LOG_INFO("[UTENTE %d] Servito alla stazione %d\n", user_id, station_type);
+        return res->quantita;
+    }
+
+    if (res->esito == 1) {
+        LOG_INFO("[UTENTE %d] Piatto terminato alla stazione %d\n", user_id, station_type);
+        return 0;
+    }
+
+    if (res->esito == 2) {
+        LOG_INFO("[UTENTE %d] Nessun piatto disponibile alla stazione %d\n", user_id, station_type);
+        return 0;
+    }
+
+    return 0;
+}
 
+/* ---------------------------------------------------------
+   Richiesta piatto a una stazione
+   Ritorna le porzioni servite (al piu' quantita), 0 se il piatto
+   e' terminato, RINUNCIA se l'utente ha lasciato la coda
+   --------------------------------------------------------- */
+static int go_to_station(int station_type, int piatto, int quantita, int ripetuta) {
+    msg_response_t res;
+
+    int msgid = get_msg_queue(station_type);
+
+    uint16_t seq;
+
+    if (balk_at_station(station_type))
+        return RINUNCIA;
+    if (!send_station_request(station_type, piatto, quantita, ripetuta, &seq))
+        return 0;
+
+    uint64_t scadenza = pazienza_ns ? sim_now_ns() + pazienza_ns : 0;
     size_t res_size = MSG_RES_SIZE;
     ssize_t received;
 
     while (1) {
         if (!shm->simulation_running) {
-            printf("[UTENTE %d] Simulazione terminata mentre ero in attesa\n", user_id);
+            LOG_INFO("[UTENTE %d] Simulazione terminata mentre ero in attesa\n", user_id);
             return 0;
         }
 
-        /* QUI: mtype = user_id+ 10000 */
-        received = msgrcv(msgid, &res, res_size, user_id+ 10000, IPC_NOWAIT | MSG_NOERROR);
+        if (scadenza && sim_now_ns() >= scadenza) {
+            if (renege_from_station(station_type, seq))
+                return RINUNCIA;
+            scadenza = 0;   // gia' presa da un operatore: attende la risposta
+        }
+
+        received = msgrcv(msgid, &res, res_size, MTYPE_RISPOSTA(user_id), IPC_NOWAIT | MSG_NOERROR);
 
         if (received >= 0) {
-            if (res.user_id != user_id) {
+            if (res.user_id != (uint32_t)user_id) {
                 //printf("[UTENTE %d] ATTENZIONE: Ricevuto messaggio per utente %d alla stazione %d, ignoro\n",
                 //       user_id, res.user_id, station_type);
                 continue;  
@@ -214,38 +557,20 @@ static int go_to_station(int station_type, int piatto) {
         }
 
         if (errno != ENOMSG) {
-            fprintf(stderr, "[UTENTE DEBUG] msgrcv fallita: msgid=%d, res_size=%zu, mtype=%d, errno=%d\n",
-        msgid, (size_t)MSG_RES_SIZE, user_id, errno);
+            fprintf(stderr, "[UTENTE DEBUG] msgrcv fallita: msgid=%d, res_size=%zu, mtype=%ld, errno=%d\n",
+        msgid, (size_t)MSG_RES_SIZE, MTYPE_RISPOSTA(user_id), errno);
             perror("[UTENTE] msgrcv");
             return 0;
         }
 
-        nanosleep(&(struct timespec){0, 50000000}, NULL);
-    }
-
-    /* Gestione esito */
-    if (res.esito == 0) {
-        printf("[UTENTE %d] Servito alla stazione %d\n", user_id, station_type);
-        return 1;
-    }
-
-    if (res.esito == 1) {
-        printf("[UTENTE %d] Piatto terminato alla stazione %d\n", user_id, station_type);
-        return 0;
-    }
-
-    if (res.esito == 2) {
-        printf("[UTENTE %d] Nessun piatto disponibile alla stazione %d\n", user_id, station_type);
-        return 0;
+        sim_poll(5);
     }
 
-    return 0;
+    return station_outcome(station_type, piatto, &res);
 }
 
-static int try_all_dishes_of_type(int station_type, int max_types) {
-    int dishes[MAX_PRIMI_TYPES];
-    int count = (max_types < MAX_PRIMI_TYPES) ? max_types : MAX_PRIMI_TYPES;
-    
+/* Ordine casuale in cui provare i piatti di una stazione */
+static int shuffle_dishes(int *dishes, int count) {
     for (int i = 0; i < count; i++) {
         dishes[i] = i;
     }
@@ -257,69 +582,187 @@ static int try_all_dishes_of_type(int station_type, int max_types) {
         dishes[i] = dishes[j];
         dishes[j] = temp;
     }
+
+    return count;
+}
+
+/* ---------------------------------------------------------
+   Preordine (PREORDER 1): le richieste a primi e secondi partono
+   insieme e le risposte vengono raccolte man mano che arrivano,
+   dalla coda di ciascuna stazione. Se un piatto e' terminato si
+   invia subito la richiesta per il successivo. Il coffee si chiede
+   solo dopo aver ottenuto un primo o un secondo, come nel percorso
+   sequenziale: chi resta senza piatti non ha un coffee da pagare.
+   Alla fine want_* / got_* valgono come nel percorso sequenziale.
+   --------------------------------------------------------- */
+static int preorder_send(int s, int piatto, uint16_t *seq, uint64_t *scadenza) {
+    if (balk_at_station(s) || !send_station_request(s, piatto, 1, 0, seq))
+        return 0;
+    *scadenza = pazienza_ns ? sim_now_ns() + pazienza_ns : 0;
+    return 1;
+}
+
+static void preorder_stations(void) {
+    int attesa[3]   = { want_primo, want_secondo, want_coffee };
+    int ottenuto[3] = { 0, 0, 0 };
+    int massimo = menu_count(PORTATA_PRIMI) > menu_count(PORTATA_SECONDI)
+                ? menu_count(PORTATA_PRIMI) : menu_count(PORTATA_SECONDI);
+    int dishes[3][massimo];
+    int count[3], prossimo[3] = { 0, 0, 0 };
+
+    count[0] = shuffle_dishes(dishes[0], menu_count(PORTATA_PRIMI));
+    count[1] = shuffle_dishes(dishes[1], menu_count(PORTATA_SECONDI));
+    count[2] = 1;
+    dishes[2][0] = 0;   // come nel percorso sequenziale: un solo tentativo al coffee
+
+    uint16_t seq[3];
+    uint64_t scadenza[3] = { 0, 0, 0 };     // pazienza per la richiesta in corso
+    int coffee_sospeso = attesa[2];         // parte dopo il primo piatto ottenuto
+
+    attesa[2] = 0;
+    for (int s = 0; s < 2; s++) {
+        if (attesa[s])
+            attesa[s] = count[s] > 0 &&
+                        preorder_send(s, dishes[s][prossimo[s]++], &seq[s], &scadenza[s]);
+    }
+
+    while (attesa[0] || attesa[1] || attesa[2]) {
+        if (!shm->simulation_running) {
+            LOG_INFO("[UTENTE %d] Simulazione terminata mentre attendevo il preordine\n", user_id);
+            break;
+        }
+
+        int ricevute = 0;
+        for (int s = 0; s < 3; s++) {
+            msg_response_t res;
+
+            if (!attesa[s])
+                continue;
+            if (scadenza[s] && sim_now_ns() >= scadenza[s]) {
+                if (renege_from_station(s, seq[s])) {
+                    attesa[s] = 0;
+                    continue;
+                }
+                scadenza[s] = 0;    // gia' presa da un operatore: attende la risposta
+            }
+
+            ssize_t received = msgrcv(get_msg_queue(s), &res, MSG_RES_SIZE, MTYPE_RISPOSTA(user_id),
+                                      IPC_NOWAIT | MSG_NOERROR);
+            if (received < 0) {
+                if (errno != ENOMSG) {
+                    perror("[UTENTE] msgrcv preordine");
+                    attesa[s] = 0;
+                }
+                continue;
+            }
+            if (res.user_id != (uint32_t)user_id)
+                continue;
+
+            ricevute++;
+            if (station_outcome(s, dishes[s][prossimo[s] - 1], &res)) {
+                ottenuto[s] = 1;
+                attesa[s] = 0;
+                if (coffee_sospeso) {
+                    coffee_sospeso = 0;
+                    attesa[2] = preorder_send(2, dishes[2][prossimo[2]++], &seq[2], &scadenza[2]);
+                }
+            } else if (prossimo[s] >= count[s] ||
+                       !send_station_request(s, dishes[s][prossimo[s]++], 1, 1, &seq[s])) {
+                attesa[s] = 0;
+            } else {
+                /* Nuova richiesta: la pazienza riparte, come per go_to_station */
+                scadenza[s] = pazienza_ns ? sim_now_ns() + pazienza_ns : 0;
+                __sync_fetch_and_add(&get_station(s)->richieste_ripetute, 1);
+            }
+        }
+
+        if (ricevute == 0)
+            sim_poll(5);
+    }
+
+    want_primo   = want_primo && ottenuto[0];
+    want_secondo = want_secondo && ottenuto[1];
+    got_primo    = ottenuto[0];
+    got_secondo  = ottenuto[1];
+    got_coffee   = ottenuto[2];
+
+    LOG_INFO("[UTENTE %d] Preordine completato (Primo:%d Secondo:%d Coffee:%d)\n",
+             user_id, got_primo, got_secondo, got_coffee);
+}
+
+/* Prova i piatti della stazione in ordine casuale finche' non ottiene
+   quantita porzioni; ritorna le porzioni ottenute */
+static int try_all_dishes_of_type(int station_type, int max_types, int quantita) {
+    int dishes[max_types];
+    int count = shuffle_dishes(dishes, max_types);
+    int ottenute = 0;
     
-    for (int i = 0; i < count; i++) {
+    for (int i = 0; i < count && ottenute < quantita; i++) {
         if (!shm->simulation_running) {
-            return 0;
+            return ottenute;
         }
         
-        int result = go_to_station(station_type, dishes[i]);
+        if (i > 0)
+            __sync_fetch_and_add(&get_station(station_type)->richieste_ripetute, 1);
+        int result = go_to_station(station_type, dishes[i], quantita - ottenute, i > 0);
         
-        if (result == 1) {
-            /* Piatto ottenuto con successo */
-            return 1;
+        if (result == RINUNCIA) {
+            /* Ha lasciato la coda: non riprova questa stazione */
+            return ottenute;
         }
-        
-        /* Se esito = 1 (piatto terminato), prova il prossimo */
-        /* Se esito = 2 (tutti terminati), prova comunque gli altri per sicurezza */
+
+        /* Piatto terminato (anche solo in parte): prova il prossimo per il resto */
+        ottenute += result;
     }
     
-    /* Nessun piatto disponibile */
-    return 0;
+    return ottenute;
 }
 
-static int go_to_cassa(void) {
+static int go_to_cassa(int n_primi, int n_secondi, int n_coffee, int quantita) {
     msg_request_t  req;
     msg_response_t res;
 
     int msgid = get_msg_queue(3);
 
     memset(&req, 0, sizeof(req));
-    req.mtype        = 1;
     req.user_id        = user_id;
     req.richiesta_tipo = 3;   // cassa
     req.piatto_scelto  = 0;
     
-    req.ha_primo   = got_primo;
-    req.ha_secondo = got_secondo;
-    req.ha_coffee  = got_coffee;
+    req.n_primi    = n_primi;
+    req.n_secondi  = n_secondi;
+    req.n_coffee   = n_coffee;
+    req.quantita   = quantita;
+    req.seq        = enqueue_slot(3);
     
-    clock_gettime(CLOCK_REALTIME, &req.t_arrivo);
+    req.t_arrivo_ns = sim_now_ns();
+    req.mtype       = ipc_request_mtype(3, user_id, n_primi + n_secondi + n_coffee, req.t_arrivo_ns);
     
-    printf("[UTENTE %d] Va alla cassa per pagare (Primo:%d Secondo:%d Coffee:%d)\n", 
-           user_id, got_primo, got_secondo, got_coffee);
+    LOG_INFO("[UTENTE %d] Va alla cassa per pagare (Primi:%d Secondi:%d Coffee:%d)\n", 
+           user_id, n_primi, n_secondi, n_coffee);
 
     size_t req_size = MSG_REQ_SIZE;
     if (msgsnd(msgid, &req, req_size, 0) < 0) {
         perror("[UTENTE] msgsnd cassa");
         return 0;
     }
+    trace_event(TR_ENQUEUE, user_id, 3, 0, 0);
 
     size_t res_size = MSG_RES_SIZE;
     ssize_t received;
     
     while (1) {
         if (!shm->simulation_running) {
-            printf("[UTENTE %d] Simulazione terminata mentre ero in coda alla cassa\n", user_id);
+            LOG_INFO("[UTENTE %d] Simulazione terminata mentre ero in coda alla cassa\n", user_id);
             return 0;
         }
         
         /* Prova a ricevere con IPC_NOWAIT e MSG_NOERROR */
-        received = msgrcv(msgid, &res, res_size, user_id+ 10000, IPC_NOWAIT | MSG_NOERROR);
+        received = msgrcv(msgid, &res, res_size, MTYPE_RISPOSTA(user_id), IPC_NOWAIT | MSG_NOERROR);
         
         if (received >= 0) {
-            if (res.user_id != user_id) {
-                printf("[UTENTE %d] ATTENZIONE: Ricevuto messaggio per utente %d, ignoro\n",
+            if (res.user_id != (uint32_t)user_id) {
+                LOG_WARN("[UTENTE %d] ATTENZIONE: Ricevuto messaggio per utente %d, ignoro\n",
                        user_id, res.user_id);
                 continue; 
             }
@@ -332,79 +775,270 @@ static int go_to_cassa(void) {
             return 0;
         }
         
-        nanosleep(&(struct timespec){0, 50000000}, NULL);
+        sim_poll(5);
     }
 
+    trace_event(TR_DISH_OUTCOME, user_id, 3, res.esito, 0);
+
     if (res.esito == 0) {
-        printf("[UTENTE %d] Ha pagato alla cassa\n", user_id);
+        trace_event(TR_PAYMENT, user_id, 3, 0, 0);
+        LOG_INFO("[UTENTE %d] Ha pagato alla cassa\n", user_id);
         return 1;
     }
     
-    printf("[UTENTE %d] Errore al pagamento alla cassa (esito=%d)\n", user_id, res.esito);
+    LOG_INFO("[UTENTE %d] Errore al pagamento alla cassa (esito=%d)\n", user_id, res.esito);
     return 0;
 }
 
-static void go_to_tavolo_and_eat(void) {
-    printf("[UTENTE %d] Cerca un tavolo libero...\n", user_id);
+/* ---------------------------------------------------------
+   Posti a tavola. Il semaforo contatore conta i posti liberi per
+   tutti e i singoli attendono su di esso. Con i gruppi la mappa dei
+   posti da' a ogni utente un posto preciso: un gruppo cerca un blocco
+   di posti adiacenti e, se non c'e', riprova dopo un polling. Ritorna
+   il primo posto occupato (0 senza gruppi), -1 se non ha preso posti.
+   --------------------------------------------------------- */
+static int try_take_seats(int posti) {
+    if (posti > 1) {
+        int primo = seats_try_block(posti, &shm->sem_tavoli);
+        if (primo >= 0 && !shm->simulation_running) {
+            /* Unita' dei post della chiusura della giornata */
+            seats_release_block(primo, posti);
+            for (int i = 0; i < posti; i++)
+                sem_post(&shm->sem_tavoli);
+            return -1;
+        }
+        return primo;
+    }
+
+    /* Un gruppo attende da troppo: i singoli lasciano liberare un blocco */
+    if (groups_enabled(shm) && seats_priority_pending()) {
+        sim_poll(1);
+        return -1;
+    }
+
+    struct timespec timeout;
+    sim_poll_deadline(&timeout, 5);
+
+    if (lock_timedwait(&shm->sem_tavoli, &shm->sem_tavoli_stat, &timeout) == 0) {
+        if (shm->simulation_running)
+            return groups_enabled(shm) ? seats_take_single() : 0;
+        /* Svegliato dalla chiusura della giornata */
+        lock_post(&shm->sem_tavoli, &shm->sem_tavoli_stat);
+        return -1;
+    }
+    if (errno != ETIMEDOUT)
+        perror("[UTENTE] sem_timedwait tavoli");
+    return -1;
+}
+
+static void release_seats(int primo, int posti) {
+    if (groups_enabled(shm))
+        seats_release_block(primo, posti);
+
+    if (posti > 1) {
+        for (int i = 0; i < posti; i++)
+            sem_post(&shm->sem_tavoli);
+    } else {
+        lock_post(&shm->sem_tavoli, &shm->sem_tavoli_stat);
+    }
+}
+
+/* Siede con posti utenti e mangia per minuti simulati; 0 se la giornata finisce prima */
+static int go_to_tavolo_and_eat(int posti, int minuti, long *attesa_posti_ns) {
+    PROF_DECL(t_fase);
+    PROF_START(t_fase);
+    LOG_DEBUG("[UTENTE %d] Cerca %d posti liberi...\n", user_id, posti);
+
+    uint64_t t_cerca = sim_now_ns();
+    long precedenza_ns = sim_min_to_ns(GRUPPO_PRECEDENZA_MINUTI);
+    int in_precedenza = 0;
+    int primo;
     
-    while (1) {
+    while ((primo = try_take_seats(posti)) < 0) {
         if (!shm->simulation_running) {
-            printf("[UTENTE %d] Giornata terminata mentre cercavo tavolo, non servito\n", user_id);
-            sem_wait(&shm->sem_stats);
-            shm->stats_giorno.utenti_non_serviti++;
-            shm->stats_giorno.utenti_in_attesa++;
-            sem_post(&shm->sem_stats);
-            return;
-        }
-        
-        /* Prova ad acquisire un posto con timeout */
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_nsec += 100000000; // 100ms
-        if (timeout.tv_nsec >= 1000000000) {
-            timeout.tv_sec++;
-            timeout.tv_nsec -= 1000000000;
-        }
-        
-        if (sem_timedwait(&shm->sem_tavoli, &timeout) == 0) {
-            /* Tavolo acquisito - il semaforo decrementa automaticamente */
-            /* Aggiorna contatore per statistiche */
-            __sync_fetch_and_sub(&shm->tavoli_liberi, 1);
-            break;
+            if (in_precedenza)
+                seats_priority(-1);
+            LOG_INFO("[UTENTE %d] Giornata terminata mentre cercavo tavolo, non servito\n", user_id);
+            lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+            shm->stats_giorno.utenti_non_serviti += posti;
+            shm->stats_giorno.utenti_in_attesa += posti;
+            lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+            return 0;
         }
-        
-        /* Timeout scaduto, controlla se la simulazione è ancora attiva */
-        if (errno != ETIMEDOUT) {
-            perror("[UTENTE] sem_timedwait tavoli");
-            return;
+        if (posti > 1) {
+            if (!in_precedenza && (long)(sim_now_ns() - t_cerca) >= precedenza_ns) {
+                seats_priority(1);
+                in_precedenza = 1;
+            }
+            sim_poll(1);
         }
     }
+    if (in_precedenza)
+        seats_priority(-1);
+
+    /* Aggiorna contatore per statistiche */
+    __sync_fetch_and_sub(&shm->tavoli_liberi, posti);
+    trace_event(TR_SEAT_ACQUIRED, user_id, 0, 0, 0);
+    PROF_END(PROF_UT_TAVOLO, t_fase);
+    if (attesa_posti_ns != NULL)
+        *attesa_posti_ns = (long)(sim_now_ns() - t_cerca);
     
-    printf("[UTENTE %d] Posto a tavola acquisito (tavoli liberi ora: %d/%d)\n", 
+    LOG_INFO("[UTENTE %d] Posto a tavola acquisito (tavoli liberi ora: %d/%d)\n", 
            user_id, shm->tavoli_liberi, shm->NOFTABLESEATS);
-    
-    int piatti = got_primo + got_secondo + got_coffee;
-    int eat_ms = piatti * 1500; // 1.5 secondi per piatto
 
-    struct timespec eat_time;
-    eat_time.tv_sec  = eat_ms / 1000;
-    eat_time.tv_nsec = (eat_ms % 1000) * 1000000L;
+    PROF_START(t_fase);
+    sim_sleep_min(minuti);
+    PROF_END(PROF_UT_PASTO, t_fase);
+    LOG_INFO("[UTENTE %d] Ha finito di mangiare, lascia il tavolo\n", user_id);
     
-    struct timespec remaining = eat_time;
-    while (nanosleep(&remaining, &remaining) != 0) {
-        if (!shm->simulation_running) {
-            printf("[UTENTE %d] Giornata terminata mentre mangiavo\n", user_id);
-            break;
+    __sync_fetch_and_add(&shm->tavoli_liberi, posti);
+    release_seats(primo, posti);
+    trace_event(TR_SEAT_RELEASED, user_id, 0, 0, 0);
+    
+    LOG_INFO("[UTENTE %d] Tavolo liberato (tavoli liberi ora: %d/%d)\n", 
+           user_id, shm->tavoli_liberi, shm->NOFTABLESEATS);
+    return 1;
+}
+
+/* Assegna le porzioni servite ai membri che le volevano, nell'ordine */
+static void assign_portions(int vuole[][3], int ha[][3], int station_type, int porzioni) {
+    for (int m = 0; m < membri && porzioni > 0; m++) {
+        if (vuole[m][station_type]) {
+            ha[m][station_type] = 1;
+            porzioni--;
         }
     }
+}
 
-    printf("[UTENTE %d] Ha finito di mangiare, lascia il tavolo\n", user_id);
-    
-    __sync_fetch_and_add(&shm->tavoli_liberi, 1);
-    sem_post(&shm->sem_tavoli);
-    
-    printf("[UTENTE %d] Tavolo liberato (tavoli liberi ora: %d/%d)\n", 
-           user_id, shm->tavoli_liberi, shm->NOFTABLESEATS);
+/* ---------------------------------------------------------
+   Giornata di un gruppo, percorsa dal capogruppo per tutti i
+   membri: ognuno sceglie i propri piatti, il gruppo passa la porta
+   insieme, chiede a ogni stazione tutte le porzioni con una sola
+   richiesta, paga una volta e siede in un blocco di posti
+   adiacenti. E' servito il membro che ha ottenuto almeno un primo
+   o un secondo; il preordine non si applica ai gruppi.
+   --------------------------------------------------------- */
+static void group_day(void) {
+    int vuole[GRUPPO_MAX][3], ha[GRUPPO_MAX][3];
+    int richieste[3] = { 0, 0, 0 };
+
+    memset(ha, 0, sizeof(ha));
+    for (int m = 0; m < membri; m++) {
+        do {
+            vuole[m][0] = rand_range(0, 1);
+            vuole[m][1] = rand_range(0, 1);
+        } while (vuole[m][0] == 0 && vuole[m][1] == 0);
+        vuole[m][2] = rand_range(0, 1);
+
+        for (int s = 0; s < 3; s++)
+            richieste[s] += vuole[m][s];
+    }
+
+    __sync_fetch_and_add(&shm->st_primi.richieste, richieste[0]);
+    __sync_fetch_and_add(&shm->st_secondi.richieste, richieste[1]);
+    __sync_fetch_and_add(&shm->st_coffee.richieste, richieste[2]);
+
+    in_percorso = membri;
+    ha_rinunciato = 0;
+    draw_patience();
+
+    wait_arrival();
+    uint64_t t_ingresso = sim_now_ns();
+
+    if (!enter_canteen(membri)) {
+        if (end_day_while_waiting() == 1) return;
+
+        lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+        shm->stats_giorno.utenti_non_serviti += membri;
+        shm->stats_giorno.utenti_respinti += membri;
+        lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+
+        wait_end_of_day();
+        return;
+    }
+
+    for (int s = 0; s < 2; s++) {
+        if (richieste[s] == 0)
+            continue;
+        assign_portions(vuole, ha, s, try_all_dishes_of_type(s, menu_count(s), richieste[s]));
+        if (end_day_while_waiting() == 1) return;
+    }
+
+    /* Chi non ha ottenuto ne' primo ne' secondo lascia la giornata */
+    int mangiano = 0, n_coffee = 0;
+    for (int m = 0; m < membri; m++) {
+        if (ha[m][0] || ha[m][1]) {
+            mangiano++;
+            n_coffee += vuole[m][2];
+        }
+    }
+
+    if (mangiano < membri) {
+        lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+        shm->stats_giorno.utenti_non_serviti += membri - mangiano;
+        if (!ha_rinunciato)
+            shm->stats_giorno.utenti_in_attesa += membri - mangiano;
+        lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+        in_percorso = mangiano;
+    }
+    if (mangiano == 0) {
+        LOG_INFO("[UTENTE %d] Nessun piatto per il gruppo, abbandono il giorno\n", user_id);
+        wait_end_of_day();
+        return;
+    }
+
+    if (n_coffee > 0) {
+        int serviti = go_to_station(2, 0, n_coffee, 0);
+        for (int m = 0; m < membri && serviti > 0; m++) {
+            if ((ha[m][0] || ha[m][1]) && vuole[m][2]) {
+                ha[m][2] = 1;
+                serviti--;
+            }
+        }
+        if (end_day_while_waiting() == 1) return;
+    }
+
+    int piatti[3] = { 0, 0, 0 }, max_piatti = 0;
+    for (int m = 0; m < membri; m++) {
+        for (int s = 0; s < 3; s++)
+            piatti[s] += ha[m][s];
+        if (ha[m][0] + ha[m][1] + ha[m][2] > max_piatti)
+            max_piatti = ha[m][0] + ha[m][1] + ha[m][2];
+    }
+
+    __sync_fetch_and_add(&shm->st_cassa.richieste, mangiano);
+    if (!go_to_cassa(piatti[0], piatti[1], piatti[2], mangiano)) {
+        lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+        shm->stats_giorno.utenti_non_serviti += mangiano;
+        shm->stats_giorno.utenti_in_attesa += mangiano;
+        lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+
+        wait_end_of_day();
+        return;
+    }
+
+    long percorso_ns = (long)(sim_now_ns() - t_ingresso);
+    __sync_fetch_and_add(&shm->stats_giorno.tempo_percorso_ns, percorso_ns * mangiano);
+    __sync_fetch_and_add(&shm->stats_giorno.utenti_percorso, mangiano);
+
+    if (end_day_while_waiting() == 1) return;
+
+    /* Il gruppo mangia finche' non ha finito il membro con piu' piatti */
+    long attesa_posti_ns = 0;
+    if (!go_to_tavolo_and_eat(mangiano, max_piatti * PASTO_MINUTI_PIATTO, &attesa_posti_ns)) {
+        wait_end_of_day();
+        return;
+    }
+
+    LOG_INFO("[UTENTE %d] Il gruppo di %d ha finito e lascia la mensa per oggi\n", user_id, mangiano);
+
+    lock_wait(&shm->sem_stats, &shm->sem_stats_stat);
+    shm->stats_giorno.utenti_serviti += mangiano;
+    shm->stats_giorno.gruppi_serviti++;
+    shm->stats_giorno.tempo_gruppo_ns += percorso_ns;
+    shm->stats_giorno.attesa_posti_gruppo_ns += attesa_posti_ns;
+    lock_post(&shm->sem_stats, &shm->sem_stats_stat);
+    wait_end_of_day();
 }
 
 static int get_msg_queue(int station_type) {